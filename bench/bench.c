@@ -0,0 +1,319 @@
+// Compiler throughput benchmark over generated programs (see generate.h):
+// times each phase over several iterations and reports the median and the
+// fastest run, lexer MB/s and parser nodes/s, as a table or as JSON for
+// tracking regressions.
+//
+//   ./build/sml_bench [--functions=N] [--globals=N] [--stmts=N] [--depth=N]
+//                     [--strings=F] [--seed=N] [--iterations=N] [-O0..-O3]
+//                     [--json] [--source]
+//
+// --source prints the generated program instead.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <llvm-c/Core.h>
+
+#include "../src/arena.h"
+#include "../src/ast.h"
+#include "../src/backend.h"
+#include "../src/compiler.h"
+#include "../src/fold.h"
+#include "../src/lexer.h"
+#include "../src/llvm_gen.h"
+#include "../src/parser.h"
+#include "../src/token_buffer.h"
+#include "../src/type_check.h"
+#include "generate.h"
+
+typedef enum {
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_TYPE_CHECK,
+  PHASE_FOLD,
+  PHASE_CODEGEN,
+  PHASE_BACKEND, // optimize and emit an object
+  PHASE_END_TO_END,
+  PHASE_COUNT,
+} Phase;
+
+static const char *const phase_names[PHASE_COUNT] = {
+    [PHASE_LEX] = "lex",
+    [PHASE_PARSE] = "parse",
+    [PHASE_TYPE_CHECK] = "type_check",
+    [PHASE_FOLD] = "fold",
+    [PHASE_CODEGEN] = "codegen",
+    [PHASE_BACKEND] = "backend",
+    [PHASE_END_TO_END] = "end_to_end",
+};
+
+typedef struct {
+  GenOptions gen;
+  size_t iterations;
+  int opt_level;
+  bool json;
+  bool print_source;
+} BenchOptions;
+
+typedef struct {
+  size_t tokens;
+  size_t ast_nodes;
+  size_t ir_instructions;
+  size_t object_bytes;
+} BenchCounts;
+
+static int parse_options(BenchOptions *options, int argc, char *argv[]);
+static int run_once(const char *source, size_t len, int opt_level,
+                    LLVMTargetMachineRef machine, double *seconds,
+                    BenchCounts *counts);
+static size_t instruction_count(LLVMModuleRef module);
+static int compare_doubles(const void *a, const void *b);
+static double now_seconds(void);
+
+int main(int argc, char *argv[]) {
+  BenchOptions options = {
+      .gen = GEN_OPTIONS_DEFAULT,
+      .iterations = 5,
+      .opt_level = 0,
+  };
+  if (parse_options(&options, argc, argv) != 0) {
+    return 1;
+  }
+
+  size_t len;
+  char *source = Generate_Program(&options.gen, &len);
+  if (options.print_source) {
+    fwrite(source, 1, len, stdout);
+    free(source);
+    return 0;
+  }
+
+  Diagnostics diag = Diagnostics_New(stderr);
+  LLVMTargetMachineRef machine =
+      Backend_NewTargetMachine(options.opt_level, NULL, NULL, &diag);
+  Diagnostics_Free(&diag);
+  if (!machine) {
+    return 1;
+  }
+
+  size_t iterations = options.iterations;
+  double *seconds = malloc(sizeof(double) * PHASE_COUNT * iterations);
+  if (!seconds) {
+    perror("Unable to allocate memory");
+    return 1;
+  }
+  BenchCounts counts = {0};
+  for (size_t i = 0; i < iterations; ++i) {
+    double run[PHASE_COUNT];
+    if (run_once(source, len, options.opt_level, machine, run, &counts) !=
+        0) {
+      return 1;
+    }
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+      seconds[p * iterations + i] = run[p];
+    }
+  }
+
+  double median[PHASE_COUNT], best[PHASE_COUNT];
+  for (int p = 0; p < PHASE_COUNT; ++p) {
+    double *samples = seconds + p * iterations;
+    qsort(samples, iterations, sizeof(double), compare_doubles);
+    median[p] = samples[iterations / 2];
+    best[p] = samples[0];
+  }
+  double lex_mb_per_s = len / 1e6 / median[PHASE_LEX];
+  double parse_nodes_per_s = counts.ast_nodes / median[PHASE_PARSE];
+
+  const GenOptions *gen = &options.gen;
+  if (options.json) {
+    printf("{\n  \"config\": {\"functions\": %zu, \"globals\": %zu, "
+           "\"stmts\": %zu, \"depth\": %zu, \"strings\": %g, \"seed\": "
+           "%llu, \"iterations\": %zu, \"opt_level\": %d},\n",
+           gen->functions, gen->globals, gen->stmts, gen->depth, gen->strings,
+           (unsigned long long)gen->seed, iterations, options.opt_level);
+    printf("  \"source_bytes\": %zu, \"tokens\": %zu, \"ast_nodes\": %zu, "
+           "\"ir_instructions\": %zu, \"object_bytes\": %zu,\n",
+           len, counts.tokens, counts.ast_nodes, counts.ir_instructions,
+           counts.object_bytes);
+    printf("  \"lex_mb_per_s\": %.3f, \"parse_nodes_per_s\": %.0f,\n",
+           lex_mb_per_s, parse_nodes_per_s);
+    printf("  \"phases\": {\n");
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+      printf("    \"%s\": {\"median_s\": %.6f, \"min_s\": %.6f}%s\n",
+             phase_names[p], median[p], best[p],
+             p + 1 < PHASE_COUNT ? "," : "");
+    }
+    printf("  }\n}\n");
+  } else {
+    printf("%zu functions, %.2f MB of source, %zu tokens, %zu AST nodes, "
+           "%zu IR instructions, -O%d, %zu iterations\n",
+           gen->functions + 1, len / 1e6, counts.tokens, counts.ast_nodes,
+           counts.ir_instructions, options.opt_level, iterations);
+    printf("%-12s%14s%14s\n", "phase", "median (ms)", "min (ms)");
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+      printf("%-12s%14.3f%14.3f\n", phase_names[p], median[p] * 1e3,
+             best[p] * 1e3);
+    }
+    printf("lexer %.1f MB/s, parser %.2f M nodes/s\n", lex_mb_per_s,
+           parse_nodes_per_s / 1e6);
+  }
+
+  free(seconds);
+  free(source);
+  LLVMDisposeTargetMachine(machine);
+  return 0;
+}
+
+static int parse_options(BenchOptions *options, int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    const char *value = strchr(arg, '=');
+    value = value ? value + 1 : "";
+    if (strncmp(arg, "--functions=", 12) == 0) {
+      options->gen.functions = strtoul(value, NULL, 10);
+    } else if (strncmp(arg, "--globals=", 10) == 0) {
+      options->gen.globals = strtoul(value, NULL, 10);
+    } else if (strncmp(arg, "--stmts=", 8) == 0) {
+      options->gen.stmts = strtoul(value, NULL, 10);
+    } else if (strncmp(arg, "--depth=", 8) == 0) {
+      options->gen.depth = strtoul(value, NULL, 10);
+    } else if (strncmp(arg, "--strings=", 10) == 0) {
+      options->gen.strings = strtod(value, NULL);
+    } else if (strncmp(arg, "--seed=", 7) == 0) {
+      options->gen.seed = strtoull(value, NULL, 10);
+    } else if (strncmp(arg, "--iterations=", 13) == 0) {
+      options->iterations = strtoul(value, NULL, 10);
+    } else if (strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '3' &&
+               arg[3] == 0) {
+      options->opt_level = arg[2] - '0';
+    } else if (strcmp(arg, "--json") == 0) {
+      options->json = true;
+    } else if (strcmp(arg, "--source") == 0) {
+      options->print_source = true;
+    } else {
+      fprintf(stderr, "[Error] Unknown option %s\n", arg);
+      return 1;
+    }
+  }
+  if (options->iterations == 0 || options->gen.stmts == 0) {
+    fprintf(stderr, "[Error] iterations and stmts must be positive\n");
+    return 1;
+  }
+  return 0;
+}
+
+// Every phase in a fresh context, as one compile of sml would run them
+static int run_once(const char *source, size_t len, int opt_level,
+                    LLVMTargetMachineRef machine, double *seconds,
+                    BenchCounts *counts) {
+  Arena arena = Arena_New();
+  SmlCompiler compiler;
+  SmlCompiler_Init(&compiler, NULL, stderr);
+  int status = 1;
+
+  double start = now_seconds();
+  Lexer lexer = Lexer_New(source, len);
+  TokenBuffer tokens = TokenBuffer_New();
+  if (TokenBuffer_Lex(&tokens, &lexer) != 0) {
+    goto done;
+  }
+  seconds[PHASE_LEX] = now_seconds() - start;
+  counts->tokens = tokens.count;
+
+  start = now_seconds();
+  Parser parser =
+      Parser_NewFromTokens(lexer, &tokens, &arena, &compiler.diag);
+  AST ast;
+  if (Parse(&parser, &ast) != 0) {
+    goto done;
+  }
+  seconds[PHASE_PARSE] = now_seconds() - start;
+  counts->ast_nodes = ast.exprs.count + ast.stmts.count;
+
+  start = now_seconds();
+  AST_type_check(&ast);
+  seconds[PHASE_TYPE_CHECK] = now_seconds() - start;
+
+  start = now_seconds();
+  AST_fold(&ast);
+  seconds[PHASE_FOLD] = now_seconds() - start;
+
+  start = now_seconds();
+  LLVMModuleRef module = llvm_emit_module(&compiler, &ast, "bench.sa", machine);
+  seconds[PHASE_CODEGEN] = now_seconds() - start;
+  AST_Free(&ast);
+  if (!module) {
+    goto done;
+  }
+  counts->ir_instructions = instruction_count(module);
+
+  start = now_seconds();
+  char *object;
+  size_t object_len;
+  Diagnostics *diag = &compiler.diag;
+  Backend_SetTarget(module, machine);
+  if (Backend_Optimize(module, machine, opt_level, NULL, diag) != 0 ||
+      Backend_EmitToMemory(module, machine, EMIT_OBJ, &object, &object_len,
+                           diag) != 0) {
+    LLVMDisposeModule(module);
+    goto done;
+  }
+  seconds[PHASE_BACKEND] = now_seconds() - start;
+  counts->object_bytes = object_len;
+  free(object);
+  LLVMDisposeModule(module);
+
+  // from the source to the object, with a context of its own
+  start = now_seconds();
+  SmlCompiler fresh;
+  SmlCompiler_Init(&fresh, NULL, stderr);
+  module = SmlCompiler_CompileModule(&fresh, source, len, "bench.sa", machine);
+  if (module) {
+    Backend_SetTarget(module, machine);
+    if (Backend_Optimize(module, machine, opt_level, NULL, &fresh.diag) == 0 &&
+        Backend_EmitToMemory(module, machine, EMIT_OBJ, &object, &object_len,
+                             &fresh.diag) == 0) {
+      free(object);
+      status = 0;
+    }
+    LLVMDisposeModule(module);
+  }
+  SmlCompiler_Free(&fresh);
+  seconds[PHASE_END_TO_END] = now_seconds() - start;
+
+done:
+  TokenBuffer_Free(&tokens);
+  Lexer_Free(&lexer);
+  SmlCompiler_Free(&compiler);
+  Arena_Free(&arena);
+  return status;
+}
+
+static size_t instruction_count(LLVMModuleRef module) {
+  size_t count = 0;
+  for (LLVMValueRef fn = LLVMGetFirstFunction(module); fn;
+       fn = LLVMGetNextFunction(fn)) {
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(fn); block;
+         block = LLVMGetNextBasicBlock(block)) {
+      for (LLVMValueRef instr = LLVMGetFirstInstruction(block); instr;
+           instr = LLVMGetNextInstruction(instr)) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
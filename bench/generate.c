@@ -0,0 +1,123 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "generate.h"
+
+typedef struct {
+  char *data;
+  size_t len, capacity;
+  uint64_t state;
+} Gen;
+
+static void gen_printf(Gen *gen, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+static uint64_t gen_next(Gen *gen);
+static size_t gen_below(Gen *gen, size_t bound);
+static void gen_term(Gen *gen, const GenOptions *options, size_t fn);
+static void gen_literal(Gen *gen);
+
+char *Generate_Program(const GenOptions *options, size_t *len) {
+  Gen gen = {.state = options->seed};
+  size_t int_globals = (options->globals + 1) / 2;
+  size_t str_globals = options->globals / 2;
+
+  for (size_t i = 0; i < int_globals; ++i) {
+    gen_printf(&gen, "let g%zu = %zu;\n", i, gen_below(&gen, 1000));
+  }
+  for (size_t i = 0; i < str_globals; ++i) {
+    gen_printf(&gen, "let s%zu = ", i);
+    gen_literal(&gen);
+    gen_printf(&gen, ";\n");
+  }
+
+  for (size_t fn = 0; fn <= options->functions; ++fn) {
+    if (fn < options->functions) {
+      gen_printf(&gen, "\nfunction f%zu() -> int {\n", fn);
+    } else {
+      gen_printf(&gen, "\nfunction main() -> int {\n");
+    }
+    for (size_t s = 1; s < options->stmts; ++s) {
+      double roll = (double)gen_below(&gen, 1u << 20) / (1u << 20);
+      if (roll < options->strings) {
+        gen_printf(&gen, "  print(");
+        gen_literal(&gen);
+        gen_printf(&gen, ");\n");
+      } else if (str_globals > 0 && roll < options->strings + 0.25) {
+        gen_printf(&gen, "  print(s%zu);\n", gen_below(&gen, str_globals));
+      } else if (fn > 0) {
+        gen_printf(&gen, "  f%zu();\n", gen_below(&gen, fn));
+      } else {
+        gen_printf(&gen, "  print(\"f0\\n\");\n");
+      }
+    }
+    gen_printf(&gen, "  return ");
+    for (size_t t = 0; t < (options->depth ? options->depth : 1); ++t) {
+      gen_printf(&gen, t ? " + " : "");
+      gen_term(&gen, options, fn);
+    }
+    gen_printf(&gen, ";\n}\n");
+  }
+
+  *len = gen.len;
+  return gen.data;
+}
+
+// A number, an int global or, now and then, a call to an earlier function
+static void gen_term(Gen *gen, const GenOptions *options, size_t fn) {
+  size_t int_globals = (options->globals + 1) / 2;
+  size_t kind = gen_below(gen, 8);
+  if (kind == 0 && fn > 0) {
+    gen_printf(gen, "f%zu()", gen_below(gen, fn));
+  } else if (kind < 4 && int_globals > 0) {
+    gen_printf(gen, "g%zu", gen_below(gen, int_globals));
+  } else {
+    gen_printf(gen, "%zu", gen_below(gen, 100));
+  }
+}
+
+// Letters, spaces and now and then an escape, as real messages have
+static void gen_literal(Gen *gen) {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz     ";
+  size_t len = 4 + gen_below(gen, 28);
+  gen_printf(gen, "\"");
+  for (size_t i = 0; i < len; ++i) {
+    gen_printf(gen, "%c", alphabet[gen_below(gen, sizeof(alphabet) - 1)]);
+  }
+  gen_printf(gen, gen_below(gen, 2) ? "\\n\"" : "\"");
+}
+
+static void gen_printf(Gen *gen, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int needed = vsnprintf(gen->data + gen->len, gen->capacity - gen->len, fmt,
+                         args);
+  va_end(args);
+  if (gen->len + needed + 1 > gen->capacity) {
+    while (gen->len + needed + 1 > gen->capacity) {
+      gen->capacity = gen->capacity ? gen->capacity * 2 : 64 * 1024;
+    }
+    gen->data = realloc(gen->data, gen->capacity);
+    if (!gen->data) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+    va_start(args, fmt);
+    vsnprintf(gen->data + gen->len, gen->capacity - gen->len, fmt, args);
+    va_end(args);
+  }
+  gen->len += needed;
+}
+
+// splitmix64, the same stream on every host
+static uint64_t gen_next(Gen *gen) {
+  uint64_t z = (gen->state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+static size_t gen_below(Gen *gen, size_t bound) {
+  return bound ? gen_next(gen) % bound : 0;
+}
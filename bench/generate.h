@@ -0,0 +1,28 @@
+#ifndef SML_BENCH_GENERATE
+#define SML_BENCH_GENERATE
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Shape of a generated program
+typedef struct GenOptions {
+  size_t functions;  // besides main
+  size_t globals;    // int and str globals, half each
+  size_t stmts;      // statements per function body, the return included
+  size_t depth;      // terms of each `a + b + ...` chain
+  double strings;    // share of statements printing a string literal
+  uint64_t seed;
+} GenOptions;
+
+#define GEN_OPTIONS_DEFAULT                                                    \
+  (GenOptions) {                                                               \
+    .functions = 1000, .globals = 64, .stmts = 8, .depth = 8,                  \
+    .strings = 0.25, .seed = 1                                                 \
+  }
+
+// A valid program of that shape, the same bytes for the same options.
+// Functions only call the ones before them, so it compiles at any scale,
+// but calls fan out: the larger ones are meant to be compiled, not run.
+char *Generate_Program(const GenOptions *options, size_t *len);
+
+#endif
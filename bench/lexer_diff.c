@@ -0,0 +1,281 @@
+// Differential check of the table-driven lexer against the straight-line
+// lexer it replaced, kept below as the reference. Every input goes through
+// Lexer_NextToken, TokenBuffer_Lex and the reference, and the first token
+// they disagree on is printed. Inputs are generated programs, the same
+// programs with random bytes written over them, and any files given.
+//
+//   ./build/sml_lexer_diff [--programs=N] [files...]
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/lexer.h"
+#include "../src/lexer_scan.h"
+#include "../src/source.h"
+#include "../src/token.h"
+#include "../src/token_buffer.h"
+#include "generate.h"
+
+// Bytes the mutated inputs are made of: every class the lexer tells apart,
+// plus NUL and bytes outside ASCII
+static const char mutation_bytes[] = "-->\"\"(){};+=_az09 \t\n\v\r$"
+                                     "\x80\xff\0";
+
+typedef struct RefLexer {
+  const char *buffer;
+  size_t len;
+  size_t pos;
+} RefLexer;
+
+static Token ref_next_token(RefLexer *);
+static int diff_source(const char *name, const char *source, size_t len);
+static bool same_token(const Token *a, const Token *b);
+static void print_token(const char *who, const char *source, const Token *);
+static char *mutate(const char *source, size_t len, uint64_t *state);
+static uint64_t next_random(uint64_t *state);
+
+int main(int argc, char *argv[]) {
+  size_t programs = 32;
+  int file_count = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--programs=", 11) == 0) {
+      programs = strtoul(argv[i] + 11, NULL, 10);
+    } else {
+      argv[++file_count] = argv[i];
+    }
+  }
+
+  int failed = 0;
+  size_t inputs = 0;
+  Diagnostics diag = Diagnostics_New(stderr);
+  for (int i = 1; i <= file_count; ++i) {
+    SourceFile source;
+    if (SourceFile_Open(argv[i], &source, &diag) != 0) {
+      failed = 1;
+      continue;
+    }
+    failed |= diff_source(argv[i], source.data, source.len);
+    SourceFile_Close(&source);
+    inputs++;
+  }
+
+  uint64_t state = 1;
+  for (size_t i = 0; i < programs && !failed; ++i) {
+    GenOptions options = GEN_OPTIONS_DEFAULT;
+    options.functions = 1 + next_random(&state) % 64;
+    options.depth = 1 + next_random(&state) % 12;
+    options.strings = (next_random(&state) % 100) / 100.0;
+    options.seed = i + 1;
+    size_t len;
+    char *program = Generate_Program(&options, &len);
+    char name[64];
+    snprintf(name, sizeof(name), "program %zu", i);
+    failed |= diff_source(name, program, len);
+
+    char *mutated = mutate(program, len, &state);
+    snprintf(name, sizeof(name), "mutated program %zu", i);
+    failed |= diff_source(name, mutated, len);
+    // cut anywhere, an unterminated string or a lone '-' at the very end
+    snprintf(name, sizeof(name), "truncated program %zu", i);
+    failed |= diff_source(name, mutated, next_random(&state) % (len + 1));
+    inputs += 3;
+    free(mutated);
+    free(program);
+  }
+
+  Diagnostics_Free(&diag);
+  if (failed) {
+    return 1;
+  }
+  printf("sml_lexer_diff: %zu inputs, every token stream matches\n", inputs);
+  return 0;
+}
+
+// 0 when the three token streams are the same
+static int diff_source(const char *name, const char *source, size_t len) {
+  RefLexer ref = {.buffer = source, .len = len};
+  Lexer lexer = Lexer_New(source, len);
+  Lexer buffered = Lexer_New(source, len);
+  TokenBuffer tokens = TokenBuffer_New();
+  int status = TokenBuffer_Lex(&tokens, &buffered) == 0 ? 0 : 1;
+
+  for (size_t i = 0; status == 0; ++i) {
+    Token expected = ref_next_token(&ref);
+    Token token = Lexer_NextToken(&lexer);
+    Token stored = i < tokens.count ? TokenBuffer_At(&tokens, i)
+                                    : (Token){.type = 0};
+    if (!same_token(&expected, &token) || !same_token(&expected, &stored)) {
+      fprintf(stderr, "%s: token %zu differs\n", name, i);
+      print_token("reference", source, &expected);
+      print_token("lexer", source, &token);
+      print_token("buffer", source, &stored);
+      status = 1;
+    } else if (expected.type == TOKEN_EOF) {
+      break;
+    }
+  }
+
+  TokenBuffer_Free(&tokens);
+  Lexer_Free(&buffered);
+  Lexer_Free(&lexer);
+  return status;
+}
+
+static bool same_token(const Token *a, const Token *b) {
+  if (a->type != b->type || a->span.start != b->span.start ||
+      a->span.len != b->span.len) {
+    return false;
+  }
+  if (a->type == TOKEN_NUMBER) {
+    return a->value.number == b->value.number;
+  }
+  if (a->type == TOKEN_ILLEGAL) {
+    return a->value.char_ == b->value.char_;
+  }
+  return true;
+}
+
+static void print_token(const char *who, const char *source,
+                        const Token *token) {
+  fprintf(stderr, "  %-10s type %d at %zu, %zu bytes", who, token->type,
+          token->span.start, token->span.len);
+  if (token->type == TOKEN_NUMBER) {
+    fprintf(stderr, ", value %lld", token->value.number);
+  } else if (token->type == TOKEN_ILLEGAL) {
+    fprintf(stderr, ", char %d", token->value.char_);
+  } else if (token->type == TOKEN_IDENT || token->type == TOKEN_STRING) {
+    fprintf(stderr, ", '%.*s'", (int)token->span.len,
+            source + token->span.start);
+  }
+  fprintf(stderr, "\n");
+}
+
+/*
+ * The lexer before the transition tables, one branch per kind of token. It
+ * uses the scalar scan kernels, a keyword list and strtoll, so it shares no
+ * table with the lexer under test.
+ */
+static Token ref_next_token(RefLexer *l) {
+  const LexerScanKernels *scan = &lexer_scan_scalar;
+  l->pos = scan->skip_whitespace(l->buffer, l->pos, l->len);
+
+  Token token = {.span = {.start = l->pos, .len = 1}};
+  char c = l->pos < l->len ? l->buffer[l->pos] : 0;
+  if (c == 0) {
+    token.type = TOKEN_EOF;
+    token.span.len = 0;
+    return token;
+  }
+
+  static const struct {
+    char c;
+    TokenType type;
+  } symbols[] = {
+      {'(', TOKEN_LPAREN},    {')', TOKEN_RPAREN},
+      {'{', TOKEN_LBRACE},    {'}', TOKEN_RBRACE},
+      {';', TOKEN_SEMICOLON}, {'+', TOKEN_PLUS},
+      {'=', TOKEN_EQUAL},
+  };
+  for (size_t i = 0; i < sizeof(symbols) / sizeof(symbols[0]); ++i) {
+    if (c == symbols[i].c) {
+      l->pos++;
+      token.type = symbols[i].type;
+      return token;
+    }
+  }
+
+  if (c == '-' && l->pos + 1 < l->len && l->buffer[l->pos + 1] == '>') {
+    l->pos += 2;
+    token.type = TOKEN_ARROW;
+    token.span.len = 2;
+    return token;
+  }
+
+  if (c == '"') {
+    token.type = TOKEN_STRING;
+    token.span.start = l->pos + 1;
+    l->pos = scan->scan_string(l->buffer, l->pos + 1, l->len);
+    token.span.len = l->pos - token.span.start;
+    // the closing quote, if there is one
+    if (l->pos < l->len) {
+      l->pos++;
+    }
+    return token;
+  }
+
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+    l->pos = scan->scan_ident(l->buffer, l->pos, l->len);
+    token.span.len = l->pos - token.span.start;
+    static const struct {
+      const char *text;
+      TokenType type;
+    } keywords[] = {
+        {"function", TOKEN_FN_DECL},
+        {"int", TOKEN_TYPE_INT},
+        {"return", TOKEN_RETURN},
+        {"let", TOKEN_LET},
+    };
+    token.type = TOKEN_IDENT;
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i) {
+      if (strlen(keywords[i].text) == token.span.len &&
+          memcmp(keywords[i].text, l->buffer + token.span.start,
+                 token.span.len) == 0) {
+        token.type = keywords[i].type;
+      }
+    }
+    return token;
+  }
+
+  if (c >= '0' && c <= '9') {
+    l->pos = scan->scan_digits(l->buffer, l->pos, l->len);
+    token.span.len = l->pos - token.span.start;
+    token.type = TOKEN_NUMBER;
+    char *digits = strndup(l->buffer + token.span.start, token.span.len);
+    if (!digits) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+    token.value.number = strtoll(digits, NULL, 10);
+    free(digits);
+    return token;
+  }
+
+  l->pos++;
+  token.type = TOKEN_ILLEGAL;
+  token.value.char_ = c;
+  return token;
+}
+
+// A copy of source with about one byte in 16 replaced
+static char *mutate(const char *source, size_t len, uint64_t *state) {
+  char *mutated = malloc(len + 1);
+  if (!mutated) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  memcpy(mutated, source, len);
+  mutated[len] = 0;
+  for (size_t i = 0; i < len / 16; ++i) {
+    size_t at = next_random(state) % len;
+    mutated[at] =
+        mutation_bytes[next_random(state) % (sizeof(mutation_bytes) - 1)];
+    // a long digit run now and then, past what a long long holds
+    if (next_random(state) % 64 == 0) {
+      for (size_t d = at; d < len && d < at + 24; ++d) {
+        mutated[d] = '9';
+      }
+    }
+  }
+  return mutated;
+}
+
+// splitmix64
+static uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
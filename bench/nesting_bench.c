@@ -0,0 +1,156 @@
+// Stress benchmark for deeply nested expressions: generates
+//
+//   function main() -> int { return 1 + 1 + ... + 1; }
+//
+// with the given number of terms and runs lexing/parsing, type checking and
+// IR emission on a thread with a small fixed stack, reporting the time and
+// peak RSS after each phase. Inspection is skipped, its output alone grows
+// quadratically with the nesting depth.
+//
+//   ./build/sml_nesting_bench [terms]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <llvm-c/Core.h>
+
+#include "../src/arena.h"
+#include "../src/ast.h"
+#include "../src/compiler.h"
+#include "../src/lexer.h"
+#include "../src/llvm_gen.h"
+#include "../src/parser.h"
+#include "../src/type_check.h"
+
+// Far below the default 8 MiB, a recursive walk runs out of it within a few
+// thousand levels
+#define NESTING_BENCH_STACK (256 * 1024)
+
+typedef struct {
+  char *source;
+  size_t len;
+  size_t terms;
+  int status;
+} BenchRun;
+
+static double now_seconds(void);
+static long peak_rss_kb(void);
+static void report(const char *phase, double start);
+static char *make_source(size_t terms, size_t *len);
+static void *run(void *arg);
+
+int main(int argc, char *argv[]) {
+  BenchRun bench = {0};
+  bench.terms = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  if (bench.terms == 0) {
+    fprintf(stderr, "[Error] terms must be positive\n");
+    return 1;
+  }
+  bench.source = make_source(bench.terms, &bench.len);
+
+  printf("%zu terms, %.1f MB of source, %d KiB stack\n", bench.terms,
+         bench.len / 1e6, NESTING_BENCH_STACK / 1024);
+  printf("%-12s%12s%14s\n", "phase", "seconds", "peak RSS (KB)");
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, NESTING_BENCH_STACK);
+  pthread_t thread;
+  if (pthread_create(&thread, &attr, run, &bench) != 0) {
+    perror("Unable to start benchmark thread");
+    return 1;
+  }
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attr);
+
+  free(bench.source);
+  return bench.status;
+}
+
+static void *run(void *arg) {
+  BenchRun *bench = arg;
+  double start = now_seconds();
+
+  Arena arena = Arena_New();
+  SmlCompiler compiler;
+  SmlCompiler_Init(&compiler, LLVMGetGlobalContext(), stderr);
+  Parser parser = Parser_New(Lexer_New(bench->source, bench->len), &arena,
+                             &compiler.diag);
+  AST ast;
+  if (Parse(&parser, &ast) != 0) {
+    bench->status = 1;
+    return NULL;
+  }
+  report("parse", start);
+
+  start = now_seconds();
+  AST_type_check(&ast);
+  report("type check", start);
+
+  start = now_seconds();
+  LLVMModuleRef module = llvm_emit_module(&compiler, &ast, "nesting.sa", NULL);
+  report("codegen", start);
+  if (!module) {
+    bench->status = 1;
+    return NULL;
+  }
+
+  // the builder folds the constant chain, so main must return the term count
+  LLVMValueRef main_fn = LLVMGetNamedFunction(module, "main");
+  LLVMValueRef ret =
+      LLVMGetBasicBlockTerminator(LLVMGetEntryBasicBlock(main_fn));
+  long long result = LLVMConstIntGetSExtValue(LLVMGetOperand(ret, 0));
+  if (result != (long long)bench->terms) {
+    fprintf(stderr, "[Error] main returns %lld, expected %zu\n", result,
+            bench->terms);
+    bench->status = 1;
+  }
+
+  LLVMDisposeModule(module);
+  SmlCompiler_Free(&compiler);
+  AST_Free(&ast);
+  Lexer_Free(&parser.lexer);
+  Arena_Free(&arena);
+  return NULL;
+}
+
+static char *make_source(size_t terms, size_t *len) {
+  const char *head = "function main() -> int {\n  return 1";
+  const char *tail = ";\n}\n";
+  size_t cap = strlen(head) + (terms - 1) * 4 + strlen(tail) + 1;
+  char *source = malloc(cap);
+  if (!source) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+
+  char *out = source;
+  out += sprintf(out, "%s", head);
+  for (size_t i = 1; i < terms; ++i) {
+    memcpy(out, " + 1", 4);
+    out += 4;
+  }
+  out += sprintf(out, "%s", tail);
+  *len = out - source;
+  return source;
+}
+
+static void report(const char *phase, double start) {
+  printf("%-12s%12.3f%14ld\n", phase, now_seconds() - start, peak_rss_kb());
+}
+
+static long peak_rss_kb(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,167 @@
+// Micro-benchmark for the lexer scan kernels: runs every kernel set that the
+// host supports over synthetic inputs, then the whole lexer over a generated
+// program with each set, and reports throughput in MB/s. It is built with
+// the compiler's own flags, so the lexer row is what sml gets.
+//
+//   ./build/sml_scan_bench [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/lexer.h"
+#include "../src/lexer_scan.h"
+#include "generate.h"
+
+typedef struct {
+  const char *name;
+  char *buffer;
+  size_t len;
+  size_t run_len;
+} ScanInput;
+
+static double now_seconds(void);
+static ScanInput make_input(const char *name, size_t len, size_t run_len,
+                            const char *alphabet, char terminator);
+static size_t scan_all(LexerScanFn scan, const ScanInput *input);
+static size_t lex_all(const LexerScanKernels *kernels, const char *source,
+                      size_t len);
+static LexerScanFn pick(const LexerScanKernels *kernels, int which);
+
+int main(int argc, char *argv[]) {
+  size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+  size_t len = megabytes * 1024 * 1024;
+
+  ScanInput inputs[] = {
+      make_input("whitespace", len, 48, " \t\n", 'x'),
+      make_input("ident", len, 24, "abcdefghijklmnopqrstuvwxyz_0123456789",
+                 ' '),
+      make_input("digits", len, 12, "0123456789", ' '),
+      make_input("string", len, 64, "abc def, ghi!\\n", '"'),
+  };
+
+  const LexerScanKernels *sets[] = {
+      &lexer_scan_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+      &lexer_scan_sse2,
+#endif
+      LexerScan_Kernels(),
+  };
+  size_t set_count = sizeof(sets) / sizeof(sets[0]);
+
+  printf("%-12s", "input");
+  for (size_t s = 0; s < set_count; ++s) {
+    printf("%12s", sets[s]->name);
+  }
+  printf("    (MB/s, runs of fixed length)\n");
+
+  for (int i = 0; i < 4; ++i) {
+    printf("%-12s", inputs[i].name);
+    size_t expected = 0;
+    for (size_t s = 0; s < set_count; ++s) {
+      LexerScanFn scan = pick(sets[s], i);
+      double start = now_seconds();
+      size_t runs = scan_all(scan, &inputs[i]);
+      double elapsed = now_seconds() - start;
+
+      if (s == 0) {
+        expected = runs;
+      } else if (runs != expected) {
+        fprintf(stderr, "\n[Error] %s disagrees with scalar on %s\n",
+                sets[s]->name, inputs[i].name);
+        return 1;
+      }
+      printf("%12.1f", (double)inputs[i].len / (1024 * 1024) / elapsed);
+    }
+    printf("\n");
+    free(inputs[i].buffer);
+  }
+
+  // Lexer_NextToken, scan kernels and the transitions between them
+  GenOptions gen = GEN_OPTIONS_DEFAULT;
+  size_t program_len;
+  char *program = Generate_Program(&gen, &program_len);
+  while (program_len < len) {
+    free(program);
+    gen.functions *= 2;
+    program = Generate_Program(&gen, &program_len);
+  }
+  printf("%-12s", "lexer");
+  size_t expected = 0;
+  for (size_t s = 0; s < set_count; ++s) {
+    double start = now_seconds();
+    size_t tokens = lex_all(sets[s], program, program_len);
+    double elapsed = now_seconds() - start;
+    if (s == 0) {
+      expected = tokens;
+    } else if (tokens != expected) {
+      fprintf(stderr, "\n[Error] %s disagrees with scalar on lexer\n",
+              sets[s]->name);
+      return 1;
+    }
+    printf("%12.1f", (double)program_len / (1024 * 1024) / elapsed);
+  }
+  printf("    (a generated program)\n");
+  free(program);
+
+  return 0;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs of run_len bytes drawn from alphabet, each followed by terminator
+static ScanInput make_input(const char *name, size_t len, size_t run_len,
+                            const char *alphabet, char terminator) {
+  ScanInput input = {.name = name, .len = len, .run_len = run_len};
+  input.buffer = malloc(len);
+  size_t alphabet_len = strlen(alphabet);
+  unsigned seed = 42;
+  for (size_t i = 0; i < len; ++i) {
+    seed = seed * 1103515245 + 12345;
+    input.buffer[i] = (i % (run_len + 1) == run_len)
+                          ? terminator
+                          : alphabet[(seed >> 16) % alphabet_len];
+  }
+  return input;
+}
+
+static size_t scan_all(LexerScanFn scan, const ScanInput *input) {
+  size_t runs = 0;
+  size_t pos = 0;
+  while (pos < input->len) {
+    pos = scan(input->buffer, pos, input->len) + 1;
+    runs++;
+  }
+  return runs;
+}
+
+// Tokens in source, lexed with the given kernels instead of the host's
+static size_t lex_all(const LexerScanKernels *kernels, const char *source,
+                      size_t len) {
+  Lexer lexer = Lexer_New(source, len);
+  lexer.scan = kernels;
+  size_t tokens = 1;
+  while (Lexer_NextToken(&lexer).type != TOKEN_EOF) {
+    tokens++;
+  }
+  Lexer_Free(&lexer);
+  return tokens;
+}
+
+static LexerScanFn pick(const LexerScanKernels *kernels, int which) {
+  switch (which) {
+  case 0:
+    return kernels->skip_whitespace;
+  case 1:
+    return kernels->scan_ident;
+  case 2:
+    return kernels->scan_digits;
+  default:
+    return kernels->scan_string;
+  }
+}
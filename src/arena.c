@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "mem.h"
+
+#define ARENA_ALIGN 16
+#define ALIGN_UP(n) (((n) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+static ArenaBlock *arena_new_block(ArenaBlock *prev, size_t min_size);
+
+Arena Arena_New(void) {
+  Arena arena;
+  arena.head = NULL;
+  return arena;
+}
+
+void *Arena_Alloc(Arena *arena, size_t size) {
+  size = ALIGN_UP(size);
+  ArenaBlock *block = arena->head;
+
+  if (!block || block->capacity - block->used < size) {
+    block = arena_new_block(block, size);
+    arena->head = block;
+  }
+
+  void *ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+char *Arena_StrNDup(Arena *arena, const char *src, size_t len) {
+  char *dest = Arena_Alloc(arena, len + 1);
+  memcpy(dest, src, len);
+  dest[len] = 0;
+  return dest;
+}
+
+// Take ownership of every block of other, leaving it empty. The current head
+// stays on top so in-place growth of its last allocation keeps working.
+void Arena_Adopt(Arena *arena, Arena *other) {
+  if (!other->head) {
+    return;
+  }
+  if (!arena->head) {
+    arena->head = other->head;
+    other->head = NULL;
+    return;
+  }
+
+  ArenaBlock *tail = other->head;
+  while (tail->prev) {
+    tail = tail->prev;
+  }
+  tail->prev = arena->head->prev;
+  arena->head->prev = other->head;
+  other->head = NULL;
+}
+
+void Arena_Free(Arena *arena) {
+  ArenaBlock *block = arena->head;
+  while (block) {
+    ArenaBlock *prev = block->prev;
+    Mem_Free(block);
+    block = prev;
+  }
+  arena->head = NULL;
+}
+
+static ArenaBlock *arena_new_block(ArenaBlock *prev, size_t min_size) {
+  size_t capacity =
+      min_size > SML_ARENA_BLOCK_SIZE ? min_size : SML_ARENA_BLOCK_SIZE;
+  ArenaBlock *block = Mem_Alloc(sizeof(ArenaBlock) + capacity);
+  if (!block) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  block->prev = prev;
+  block->used = 0;
+  block->capacity = capacity;
+  return block;
+}
@@ -0,0 +1,28 @@
+#ifndef SML_ARENA
+#define SML_ARENA
+
+#include <stddef.h>
+
+#define SML_ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *prev;
+  size_t used;
+  size_t capacity;
+  _Alignas(16) unsigned char data[];
+} ArenaBlock;
+
+// Bump allocator owning everything produced for one compilation (AST nodes,
+// identifiers, string literals). Nothing is freed individually; the whole
+// arena goes away with Arena_Free.
+typedef struct Arena {
+  ArenaBlock *head;
+} Arena;
+
+Arena Arena_New(void);
+void *Arena_Alloc(Arena *, size_t size);
+char *Arena_StrNDup(Arena *, const char *src, size_t len);
+void Arena_Adopt(Arena *, Arena *other);
+void Arena_Free(Arena *);
+
+#endif
@@ -1,139 +1,440 @@
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ast.h"
+#include "mem.h"
 #include "type.h"
 
+#define AST_VEC_MIN_CAP 64
+
+// Make room for `extra` more items, returns the index of the first one
+#define AST_VEC_GROW(vec, extra)                                               \
+  ast_vec_grow((void **)&(vec).items, &(vec).count, &(vec).capacity,           \
+               sizeof(*(vec).items), (extra))
+
+#define AST_VEC_PUSH(vec, value)                                               \
+  (AST_VEC_GROW(vec, 1), (vec).items[(vec).count - 1] = (value),               \
+   (vec).count - 1)
+
+static uint32_t ast_vec_grow(void **items, uint32_t *count, uint32_t *capacity,
+                             size_t item_size, uint32_t extra) {
+  if (*count + extra > *capacity) {
+    uint32_t new_capacity = *capacity ? *capacity : AST_VEC_MIN_CAP;
+    while (new_capacity < *count + extra) {
+      new_capacity *= 2;
+    }
+    void *grown = Mem_Realloc(*items, item_size * new_capacity);
+    if (!grown) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+    *items = grown;
+    *capacity = new_capacity;
+  }
+  uint32_t first = *count;
+  *count += extra;
+  return first;
+}
+
+AST AST_New(void) {
+  AST ast;
+  memset(&ast, 0, sizeof(AST));
+  return ast;
+}
+
+void AST_Free(AST *ast) {
+  Mem_Free(ast->exprs.items);
+  Mem_Free(ast->calls.items);
+  Mem_Free(ast->binops.items);
+  Mem_Free(ast->idents.items);
+  Mem_Free(ast->literals.items);
+  Mem_Free(ast->call_args.items);
+  Mem_Free(ast->stmts.items);
+  Mem_Free(ast->fn_decls.items);
+  Mem_Free(ast->var_decls.items);
+  Mem_Free(ast->returns.items);
+  Mem_Free(ast->block_stmts.items);
+  *ast = AST_New();
+}
+
+static ExprId ast_add_expr(AST *ast, ExprType type, uint32_t index) {
+  ExprNode node = {.type = type, .index = index};
+  return AST_VEC_PUSH(ast->exprs, node);
+}
+
+static StmtId ast_add_stmt(AST *ast, StmtType type, uint32_t index) {
+  StmtNode node = {.type = type, .index = index};
+  return AST_VEC_PUSH(ast->stmts, node);
+}
+
+ExprId AST_AddCall(AST *ast, ExprCall call) {
+  return ast_add_expr(ast, EXPR_CALL, AST_VEC_PUSH(ast->calls, call));
+}
+
+ExprId AST_AddBinOp(AST *ast, ExprBinOp binop) {
+  return ast_add_expr(ast, EXPR_BINOP, AST_VEC_PUSH(ast->binops, binop));
+}
+
+ExprId AST_AddIdent(AST *ast, ExprIdent ident) {
+  return ast_add_expr(ast, EXPR_IDENT, AST_VEC_PUSH(ast->idents, ident));
+}
+
+ExprId AST_AddLiteral(AST *ast, ExprLiteral literal) {
+  return ast_add_expr(ast, EXPR_LITERAL,
+                      AST_VEC_PUSH(ast->literals, literal));
+}
+
+void AST_SetLiteral(AST *ast, ExprId id, ExprLiteral literal) {
+  // a new entry, the old one may be shared with another node
+  ast->exprs.items[id] = (ExprNode){
+      .type = EXPR_LITERAL,
+      .index = AST_VEC_PUSH(ast->literals, literal),
+  };
+}
+
+uint32_t AST_AddCallArgs(AST *ast, const ExprId *args, uint32_t argc) {
+  uint32_t start = AST_VEC_GROW(ast->call_args, argc);
+  if (argc) {
+    memcpy(ast->call_args.items + start, args, sizeof(ExprId) * argc);
+  }
+  return start;
+}
+
+StmtId AST_AddFnDecl(AST *ast, StmtFnDecl fn_decl) {
+  return ast_add_stmt(ast, STMT_FN_DECL,
+                      AST_VEC_PUSH(ast->fn_decls, fn_decl));
+}
+
+StmtId AST_AddVarDecl(AST *ast, StmtVarDecl var_decl) {
+  return ast_add_stmt(ast, STMT_VAR_DECL,
+                      AST_VEC_PUSH(ast->var_decls, var_decl));
+}
+
+StmtId AST_AddReturn(AST *ast, StmtReturn return_) {
+  return ast_add_stmt(ast, STMT_RETURN, AST_VEC_PUSH(ast->returns, return_));
+}
+
+StmtId AST_AddExprStmt(AST *ast, ExprId expr) {
+  return ast_add_stmt(ast, STMT_EXPR, expr);
+}
+
+StmtBlock AST_AddBlock(AST *ast, const StmtId *stmts, uint32_t stmt_count) {
+  StmtBlock block;
+  block.start = AST_VEC_GROW(ast->block_stmts, stmt_count);
+  block.stmt_count = stmt_count;
+  if (stmt_count) {
+    memcpy(ast->block_stmts.items + block.start, stmts,
+           sizeof(StmtId) * stmt_count);
+  }
+  return block;
+}
+
+#define AST_APPEND_TABLE(dst, src, field)                                      \
+  do {                                                                         \
+    if ((src)->field.count) {                                                  \
+      uint32_t at_ = AST_VEC_GROW((dst)->field, (src)->field.count);           \
+      memcpy((dst)->field.items + at_, (src)->field.items,                     \
+             sizeof(*(src)->field.items) * (src)->field.count);                \
+    }                                                                          \
+  } while (0)
+
+/*
+ * Move every node of other to the end of ast, rebasing the ids inside them.
+ * Returns other's root block as seen from ast. Used to merge ASTs that were
+ * parsed separately.
+ */
+StmtBlock AST_Append(AST *ast, const AST *other) {
+  uint32_t expr_base = ast->exprs.count;
+  uint32_t call_base = ast->calls.count;
+  uint32_t binop_base = ast->binops.count;
+  uint32_t ident_base = ast->idents.count;
+  uint32_t literal_base = ast->literals.count;
+  uint32_t call_arg_base = ast->call_args.count;
+  uint32_t stmt_base = ast->stmts.count;
+  uint32_t fn_decl_base = ast->fn_decls.count;
+  uint32_t var_decl_base = ast->var_decls.count;
+  uint32_t return_base = ast->returns.count;
+  uint32_t block_stmt_base = ast->block_stmts.count;
+
+  AST_APPEND_TABLE(ast, other, exprs);
+  AST_APPEND_TABLE(ast, other, calls);
+  AST_APPEND_TABLE(ast, other, binops);
+  AST_APPEND_TABLE(ast, other, idents);
+  AST_APPEND_TABLE(ast, other, literals);
+  AST_APPEND_TABLE(ast, other, call_args);
+  AST_APPEND_TABLE(ast, other, stmts);
+  AST_APPEND_TABLE(ast, other, fn_decls);
+  AST_APPEND_TABLE(ast, other, var_decls);
+  AST_APPEND_TABLE(ast, other, returns);
+  AST_APPEND_TABLE(ast, other, block_stmts);
+
+  for (uint32_t i = expr_base; i < ast->exprs.count; ++i) {
+    ExprNode *node = &ast->exprs.items[i];
+    switch (node->type) {
+    case EXPR_CALL:
+      node->index += call_base;
+      break;
+    case EXPR_BINOP:
+      node->index += binop_base;
+      break;
+    case EXPR_IDENT:
+      node->index += ident_base;
+      break;
+    case EXPR_LITERAL:
+      node->index += literal_base;
+      break;
+    }
+  }
+  for (uint32_t i = call_base; i < ast->calls.count; ++i) {
+    ast->calls.items[i].args_start += call_arg_base;
+  }
+  for (uint32_t i = binop_base; i < ast->binops.count; ++i) {
+    ast->binops.items[i].lhs += expr_base;
+    ast->binops.items[i].rhs += expr_base;
+  }
+  for (uint32_t i = call_arg_base; i < ast->call_args.count; ++i) {
+    ast->call_args.items[i] += expr_base;
+  }
+
+  for (uint32_t i = stmt_base; i < ast->stmts.count; ++i) {
+    StmtNode *node = &ast->stmts.items[i];
+    switch (node->type) {
+    case STMT_FN_DECL:
+      node->index += fn_decl_base;
+      break;
+    case STMT_VAR_DECL:
+      node->index += var_decl_base;
+      break;
+    case STMT_RETURN:
+      node->index += return_base;
+      break;
+    case STMT_EXPR:
+      node->index += expr_base;
+      break;
+    }
+  }
+  for (uint32_t i = fn_decl_base; i < ast->fn_decls.count; ++i) {
+    ast->fn_decls.items[i].body.start += block_stmt_base;
+  }
+  for (uint32_t i = var_decl_base; i < ast->var_decls.count; ++i) {
+    ast->var_decls.items[i].init += expr_base;
+  }
+  for (uint32_t i = return_base; i < ast->returns.count; ++i) {
+    ast->returns.items[i].operand += expr_base;
+  }
+  for (uint32_t i = block_stmt_base; i < ast->block_stmts.count; ++i) {
+    ast->block_stmts.items[i] += stmt_base;
+  }
+
+  StmtBlock root = other->root;
+  root.start += block_stmt_base;
+  return root;
+}
+
+/*  Inspect  */
+
+// An expression whose children are still being printed, step counts the
+// children already handed out
+typedef struct InspectFrame {
+  ExprId id;
+  uint32_t step;
+} InspectFrame;
+
 typedef struct InspectContext {
   FILE *file;
+  const AST *ast;
   int tab;
   int tab_rate;
+
+  InspectFrame *frames;
+  size_t frame_count;
+  size_t frame_capacity;
 } InspectContext;
 
 void inspect_write(InspectContext *ctx, char *text, ...);
 void inspect_writeln(InspectContext *ctx, char *text, ...);
 
-void AST_Inspect(AST ast);
 void insect_stmt_block(InspectContext *, StmtBlock);
-void insect_stmt_vardecl(InspectContext *, StmtVarDecl);
-void insect_stmt_function(InspectContext *, StmtFnDecl);
-void insect_stmt_return(InspectContext *, StmtReturn);
-void insect_stmt_expr(InspectContext *, StmtExpr);
-void inspect_expr_literal(InspectContext *, ExprLiteral);
-void inspect_expr_call(InspectContext *, ExprCall);
-void inspect_expr_binop(InspectContext *, ExprBinOp);
-
-void AST_Inspect(AST ast) {
+void insect_stmt_vardecl(InspectContext *, const StmtVarDecl *);
+void insect_stmt_function(InspectContext *, const StmtFnDecl *);
+void insect_stmt_return(InspectContext *, const StmtReturn *);
+void insect_stmt_expr(InspectContext *, ExprId);
+void inspect_expr_literal(InspectContext *, const ExprLiteral *);
+bool inspect_expr_call(InspectContext *, InspectFrame *);
+bool inspect_expr_binop(InspectContext *, InspectFrame *);
+static void inspect_push(InspectContext *, ExprId);
+
+void AST_Inspect(const AST *ast) {
   InspectContext ctx;
   ctx.file = stdout;
+  ctx.ast = ast;
   ctx.tab = 0;
   ctx.tab_rate = 4;
+  ctx.frames = NULL;
+  ctx.frame_count = 0;
+  ctx.frame_capacity = 0;
 
-  insect_stmt_block(&ctx, ast);
+  insect_stmt_block(&ctx, ast->root);
+  Mem_Free(ctx.frames);
 }
 
 void insect_stmt_block(InspectContext *ctx, StmtBlock block) {
-  for (size_t i = 0; i < block.stmt_count; ++i) {
-    Stmt stmt = block.stmts[i];
-    switch (stmt.type) {
+  const AST *ast = ctx->ast;
+  for (uint32_t i = 0; i < block.stmt_count; ++i) {
+    const StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, block, i)];
+    switch (stmt->type) {
     case STMT_VAR_DECL:
-      insect_stmt_vardecl(ctx, stmt.value.var_decl);
+      insect_stmt_vardecl(ctx, &ast->var_decls.items[stmt->index]);
       break;
     case STMT_FN_DECL:
-      insect_stmt_function(ctx, stmt.value.fn_decl);
+      insect_stmt_function(ctx, &ast->fn_decls.items[stmt->index]);
       break;
     case STMT_EXPR:
-      insect_stmt_expr(ctx, stmt.value.expr);
+      insect_stmt_expr(ctx, stmt->index);
       break;
     case STMT_RETURN:
-      insect_stmt_return(ctx, stmt.value.return_);
+      insect_stmt_return(ctx, &ast->returns.items[stmt->index]);
       break;
     }
   }
 }
 
-void insect_stmt_vardecl(InspectContext *ctx, StmtVarDecl var_decl) {
+void insect_stmt_vardecl(InspectContext *ctx, const StmtVarDecl *var_decl) {
   inspect_writeln(ctx, "VARIABLE DECLARATION:");
   ctx->tab += ctx->tab_rate;
-  inspect_writeln(ctx, "NAME: \"%s\"", var_decl.name);
-  inspect_writeln(ctx, "TYPE: %s", TYPE(var_decl.type));
+  inspect_writeln(ctx, "NAME: \"%s\"", var_decl->name);
+  inspect_writeln(ctx, "TYPE: %s", TYPE(var_decl->type));
   inspect_write(ctx, "INIT:\n");
   ctx->tab += ctx->tab_rate;
-  insect_stmt_expr(ctx, *var_decl.init);
+  insect_stmt_expr(ctx, var_decl->init);
   ctx->tab -= (ctx->tab_rate * 2);
 }
 
-void insect_stmt_function(InspectContext *ctx, StmtFnDecl fn) {
+void insect_stmt_function(InspectContext *ctx, const StmtFnDecl *fn) {
   inspect_writeln(ctx, "FUNCTION DECLARATION:");
   ctx->tab += ctx->tab_rate;
-  inspect_writeln(ctx, "NAME: \"%s\"", fn.name);
-  inspect_writeln(ctx, "RETURN TYPE: %s", TYPE(fn.return_type));
+  inspect_writeln(ctx, "NAME: \"%s\"", fn->name);
+  inspect_writeln(ctx, "RETURN TYPE: %s", TYPE(fn->return_type));
   inspect_writeln(ctx, "BODY:");
   ctx->tab += ctx->tab_rate;
-  insect_stmt_block(ctx, fn.body);
+  insect_stmt_block(ctx, fn->body);
   ctx->tab -= (ctx->tab_rate * 2);
 }
 
-void insect_stmt_return(InspectContext *ctx, StmtReturn ret) {
+void insect_stmt_return(InspectContext *ctx, const StmtReturn *ret) {
   inspect_writeln(ctx, "RETURN STATEMENT:");
   ctx->tab += ctx->tab_rate;
-  insect_stmt_expr(ctx, ret.operand);
+  insect_stmt_expr(ctx, ret->operand);
   ctx->tab -= ctx->tab_rate;
 }
 
-void insect_stmt_expr(InspectContext *ctx, StmtExpr expr) {
-  switch (expr.type) {
-  case EXPR_LITERAL:
-    inspect_expr_literal(ctx, expr.value.literal);
-    break;
-  case EXPR_CALL:
-    inspect_expr_call(ctx, expr.value.call);
-    break;
-  case EXPR_BINOP:
-    inspect_expr_binop(ctx, expr.value.binop);
-    break;
-  case EXPR_IDENT:
-    puts("[WARNING] couldn't inspect EXPR_IDENT");
-    break;
+/*
+ * Expressions are walked with an explicit stack so arbitrarily deep nesting
+ * can't overflow the machine stack. Each step of a call or binop either
+ * prints its own lines and pushes one child, or reports that it is done.
+ */
+void insect_stmt_expr(InspectContext *ctx, ExprId id) {
+  const AST *ast = ctx->ast;
+  size_t base = ctx->frame_count;
+  inspect_push(ctx, id);
+
+  while (ctx->frame_count > base) {
+    InspectFrame *frame = &ctx->frames[ctx->frame_count - 1];
+    const ExprNode *expr = &ast->exprs.items[frame->id];
+    bool done = true;
+    switch (expr->type) {
+    case EXPR_LITERAL:
+      inspect_expr_literal(ctx, &ast->literals.items[expr->index]);
+      break;
+    case EXPR_CALL:
+      done = inspect_expr_call(ctx, frame);
+      break;
+    case EXPR_BINOP:
+      done = inspect_expr_binop(ctx, frame);
+      break;
+    case EXPR_IDENT:
+      puts("[WARNING] couldn't inspect EXPR_IDENT");
+      break;
+    }
+    if (done) {
+      ctx->frame_count--;
+    }
+  }
+}
+
+static void inspect_push(InspectContext *ctx, ExprId id) {
+  if (ctx->frame_count == ctx->frame_capacity) {
+    ctx->frame_capacity = ctx->frame_capacity ? ctx->frame_capacity * 2 : 16;
+    ctx->frames =
+        Mem_Realloc(ctx->frames, sizeof(InspectFrame) * ctx->frame_capacity);
+    if (!ctx->frames) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
   }
+  ctx->frames[ctx->frame_count++] = (InspectFrame){.id = id, .step = 0};
 }
 
-void inspect_expr_literal(InspectContext *ctx, ExprLiteral literal) {
-  switch (literal.type) {
+void inspect_expr_literal(InspectContext *ctx, const ExprLiteral *literal) {
+  switch (literal->type) {
   case EXPR_LITERAL_NUM:
-    inspect_writeln(ctx, "LITERAL(%lld)", literal.value.number);
+    inspect_writeln(ctx, "LITERAL(%lld)", literal->value.number);
     break;
   case EXPR_LITERAL_STR:
-    inspect_writeln(ctx, "LITERAL(\"%s\")", literal.value.string);
+    inspect_writeln(ctx, "LITERAL(\"%s\")", literal->value.string);
     break;
   }
 }
 
-void inspect_expr_call(InspectContext *ctx, ExprCall call) {
-  inspect_writeln(ctx, "FUNCTION CALL:");
-  ctx->tab += ctx->tab_rate;
-  inspect_writeln(ctx, "NAME: \"%s\"", call.name);
+bool inspect_expr_call(InspectContext *ctx, InspectFrame *frame) {
+  const AST *ast = ctx->ast;
+  const ExprCall *call = &ast->calls.items[ast->exprs.items[frame->id].index];
+  uint32_t step = frame->step++;
 
-  inspect_writeln(ctx, "ARGS: [");
-  ctx->tab += ctx->tab_rate;
-  for (size_t i = 0; i < call.args.argc; ++i) {
-    insect_stmt_expr(ctx, call.args.argv[i]);
+  if (step == 0) {
+    inspect_writeln(ctx, "FUNCTION CALL:");
+    ctx->tab += ctx->tab_rate;
+    inspect_writeln(ctx, "NAME: \"%s\"", call->name);
+
+    inspect_writeln(ctx, "ARGS: [");
+    ctx->tab += ctx->tab_rate;
+  }
+  if (step < call->argc) {
+    inspect_push(ctx, AST_CallArg(ast, call, step));
+    return false;
   }
   ctx->tab -= ctx->tab_rate;
   inspect_writeln(ctx, "]");
   ctx->tab -= ctx->tab_rate;
+  return true;
 }
 
-void inspect_expr_binop(InspectContext *ctx, ExprBinOp binop) {
-  inspect_writeln(ctx, "BINARY EXPRESSION:");
-  ctx->tab += ctx->tab_rate;
-  insect_stmt_expr(ctx, *binop.lhs);
-  switch (binop.op) {
-  case BINOP_PLUS:
-    inspect_writeln(ctx, "+");
-    break;
+bool inspect_expr_binop(InspectContext *ctx, InspectFrame *frame) {
+  const AST *ast = ctx->ast;
+  const ExprBinOp *binop =
+      &ast->binops.items[ast->exprs.items[frame->id].index];
+
+  switch (frame->step++) {
+  case 0:
+    inspect_writeln(ctx, "BINARY EXPRESSION:");
+    ctx->tab += ctx->tab_rate;
+    inspect_push(ctx, binop->lhs);
+    return false;
+  case 1:
+    switch (binop->op) {
+    case BINOP_PLUS:
+      inspect_writeln(ctx, "+");
+      break;
+    }
+    inspect_push(ctx, binop->rhs);
+    return false;
+  default:
+    ctx->tab -= ctx->tab_rate;
+    return true;
   }
-  insect_stmt_expr(ctx, *binop.rhs);
-  ctx->tab -= ctx->tab_rate;
 }
 
 void inspect_writeln(InspectContext *ctx, char *f, ...) {
@@ -2,11 +2,21 @@
 #define SML_AST
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "type.h"
 
-#define SML_BLOCK_STMT_CAP 25
-#define SML_CALL_ARGS_CAP 25
+/*
+ * The AST is a flat node pool. Every expression and statement is an 8-byte
+ * {kind, index} node addressed by a 32-bit id; index points into the side
+ * table for that kind, which holds the node's payload. Children are ids, and
+ * variable-length children (block statements, call arguments) are contiguous
+ * ranges of ids in a shared list. Walkers pass ids around and read nodes in
+ * place, nothing is copied by value.
+ */
+
+typedef uint32_t ExprId;
+typedef uint32_t StmtId;
 
 typedef enum StmtType {
   STMT_FN_DECL = 1,
@@ -29,22 +39,29 @@ typedef enum ExprLiteralType {
 
 typedef enum BinOperator { BINOP_PLUS = 1 } BinOperator;
 
+#define AST_VEC(T)                                                             \
+  struct {                                                                     \
+    T *items;                                                                  \
+    uint32_t count;                                                            \
+    uint32_t capacity;                                                         \
+  }
+
 /*  Exprs  */
 
-typedef struct ExprCallArgs {
-  size_t argc;
-  size_t capacity;
-  struct StmtExpr *argv;
-} ExprCallArgs;
+typedef struct ExprNode {
+  uint8_t type; // ExprType
+  uint32_t index;
+} ExprNode;
 
 typedef struct ExprCall {
   char *name;
-  ExprCallArgs args;
+  uint32_t args_start; // into AST.call_args
+  uint32_t argc;
 } ExprCall;
 
 typedef struct ExprBinOp {
-  struct StmtExpr *lhs;
-  struct StmtExpr *rhs;
+  ExprId lhs;
+  ExprId rhs;
   BinOperator op;
 } ExprBinOp;
 
@@ -62,28 +79,20 @@ typedef struct ExprLiteral {
   ExprLiteralValue value;
 } ExprLiteral;
 
-typedef union ExprValue {
-  ExprCall call;
-  ExprIdent ident;
-  ExprLiteral literal;
-  ExprBinOp binop;
-} ExprValue;
-
-typedef struct StmtExpr {
-  ExprType type;
-  ExprValue value;
-} StmtExpr;
-
 /*  Stmts  */
 
+typedef struct StmtNode {
+  uint8_t type; // StmtType
+  uint32_t index; // the ExprId itself for STMT_EXPR
+} StmtNode;
+
 typedef struct StmtBlock {
-  struct Stmt *stmts;
-  size_t capacity;
-  size_t stmt_count;
+  uint32_t start; // into AST.block_stmts
+  uint32_t stmt_count;
 } StmtBlock;
 
 typedef struct ReturnStmt {
-  StmtExpr operand;
+  ExprId operand;
 } StmtReturn;
 
 typedef struct StmtFnDecl {
@@ -94,24 +103,57 @@ typedef struct StmtFnDecl {
 
 typedef struct StmtVarDecl {
   char *name;
-  StmtExpr *init;
+  ExprId init;
   Type type;
 } StmtVarDecl;
 
-typedef union StmtValue {
-  StmtExpr expr;
-  StmtFnDecl fn_decl;
-  StmtReturn return_;
-  StmtVarDecl var_decl;
-} StmtValue;
-
-typedef struct Stmt {
-  StmtType type;
-  StmtValue value;
-} Stmt;
-
-typedef StmtBlock AST;
-
-void AST_Inspect(AST ast);
+typedef struct AST {
+  AST_VEC(ExprNode) exprs;
+  AST_VEC(ExprCall) calls;
+  AST_VEC(ExprBinOp) binops;
+  AST_VEC(ExprIdent) idents;
+  AST_VEC(ExprLiteral) literals;
+  AST_VEC(ExprId) call_args;
+
+  AST_VEC(StmtNode) stmts;
+  AST_VEC(StmtFnDecl) fn_decls;
+  AST_VEC(StmtVarDecl) var_decls;
+  AST_VEC(StmtReturn) returns;
+  AST_VEC(StmtId) block_stmts;
+
+  StmtBlock root;
+} AST;
+
+AST AST_New(void);
+void AST_Free(AST *);
+
+ExprId AST_AddCall(AST *, ExprCall);
+ExprId AST_AddBinOp(AST *, ExprBinOp);
+ExprId AST_AddIdent(AST *, ExprIdent);
+ExprId AST_AddLiteral(AST *, ExprLiteral);
+uint32_t AST_AddCallArgs(AST *, const ExprId *args, uint32_t argc);
+
+StmtId AST_AddFnDecl(AST *, StmtFnDecl);
+StmtId AST_AddVarDecl(AST *, StmtVarDecl);
+StmtId AST_AddReturn(AST *, StmtReturn);
+StmtId AST_AddExprStmt(AST *, ExprId);
+StmtBlock AST_AddBlock(AST *, const StmtId *stmts, uint32_t stmt_count);
+// Turn expression id into the literal in place; whatever it pointed to is
+// left unreachable
+void AST_SetLiteral(AST *, ExprId id, ExprLiteral);
+
+StmtBlock AST_Append(AST *, const AST *other);
+
+static inline StmtId AST_BlockStmt(const AST *ast, StmtBlock block,
+                                   uint32_t i) {
+  return ast->block_stmts.items[block.start + i];
+}
+
+static inline ExprId AST_CallArg(const AST *ast, const ExprCall *call,
+                                 uint32_t i) {
+  return ast->call_args.items[call->args_start + i];
+}
+
+void AST_Inspect(const AST *ast);
 
 #endif
@@ -0,0 +1,257 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <llvm-c/Analysis.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/Transforms/PassBuilder.h>
+
+#include "backend.h"
+#include "timing.h"
+
+static const struct {
+  const char *name;
+  const char *extension;
+} emit_kinds[] = {
+    [EMIT_LL] = {"ll", ".ll"},
+    [EMIT_BC] = {"bc", ".bc"},
+    [EMIT_ASM] = {"asm", ".s"},
+    [EMIT_OBJ] = {"obj", ".o"},
+};
+
+static pthread_once_t native_once = PTHREAD_ONCE_INIT;
+static int native_status;
+
+int Backend_EmitKindFromName(const char *name, EmitKind *kind) {
+  for (EmitKind k = EMIT_LL; k <= EMIT_OBJ; ++k) {
+    if (strcmp(name, emit_kinds[k].name) == 0) {
+      *kind = k;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+const char *Backend_EmitExtension(EmitKind kind) {
+  return emit_kinds[kind].extension;
+}
+
+static void init_native(void) {
+  native_status =
+      LLVMInitializeNativeTarget() || LLVMInitializeNativeAsmPrinter();
+}
+
+int Backend_InitNative(Diagnostics *diag) {
+  pthread_once(&native_once, init_native);
+  if (native_status) {
+    Diagnostics_Error(diag, "No native target available");
+  }
+  return native_status;
+}
+
+LLVMTargetMachineRef Backend_NewTargetMachine(int opt_level, const char *cpu,
+                                              const char *features,
+                                              Diagnostics *diag) {
+  if (Backend_InitNative(diag) != 0) {
+    return NULL;
+  }
+
+  char *triple = LLVMGetDefaultTargetTriple();
+  LLVMTargetRef target;
+  char *message = NULL;
+  if (LLVMGetTargetFromTriple(triple, &target, &message)) {
+    Diagnostics_Error(diag, "Unknown target %s: %s", triple, message);
+    LLVMDisposeMessage(message);
+    LLVMDisposeMessage(triple);
+    return NULL;
+  }
+
+  char *host_cpu = NULL;
+  char *host_features = NULL;
+  if (cpu && strcmp(cpu, "native") == 0) {
+    host_cpu = LLVMGetHostCPUName();
+    host_features = LLVMGetHostCPUFeatures();
+    cpu = host_cpu;
+  }
+
+  // explicit features come last so they override the host's
+  size_t host_len = host_features ? strlen(host_features) : 0;
+  size_t extra_len = features ? strlen(features) : 0;
+  char *all_features = malloc(host_len + extra_len + 2);
+  if (!all_features) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  snprintf(all_features, host_len + extra_len + 2, "%s%s%s",
+           host_len ? host_features : "", host_len && extra_len ? "," : "",
+           extra_len ? features : "");
+
+  // LLVMCodeGenOptLevel runs None, Less, Default, Aggressive like -O0..-O3
+  LLVMTargetMachineRef machine = LLVMCreateTargetMachine(
+      target, triple, cpu ? cpu : "generic", all_features,
+      (LLVMCodeGenOptLevel)opt_level, LLVMRelocPIC, LLVMCodeModelDefault);
+  if (!machine) {
+    Diagnostics_Error(diag, "No target machine for %s", triple);
+  }
+
+  free(all_features);
+  LLVMDisposeMessage(host_features);
+  LLVMDisposeMessage(host_cpu);
+  LLVMDisposeMessage(triple);
+  return machine;
+}
+
+void Backend_SetTarget(LLVMModuleRef module, LLVMTargetMachineRef machine) {
+  char *triple = LLVMGetTargetMachineTriple(machine);
+  LLVMSetTarget(module, triple);
+  LLVMDisposeMessage(triple);
+
+  LLVMTargetDataRef layout = LLVMCreateTargetDataLayout(machine);
+  LLVMSetModuleDataLayout(module, layout);
+  LLVMDisposeTargetData(layout);
+}
+
+int Backend_Verify(LLVMModuleRef module, Diagnostics *diag) {
+  char *message = NULL;
+  if (LLVMVerifyModule(module, LLVMReturnStatusAction, &message)) {
+    // the verifier ends its report with a newline of its own
+    int len = strlen(message);
+    if (len > 0 && message[len - 1] == '\n') {
+      len--;
+    }
+    Diagnostics_Error(diag, "Invalid module:\n%.*s", len, message);
+    LLVMDisposeMessage(message);
+    return 1;
+  }
+  LLVMDisposeMessage(message);
+  return 0;
+}
+
+int Backend_Optimize(LLVMModuleRef module, LLVMTargetMachineRef machine,
+                     int opt_level, const char *passes, Diagnostics *diag) {
+  if (!passes && opt_level == 0) {
+    return 0;
+  }
+  if (Backend_Verify(module, diag) != 0) {
+    return 1;
+  }
+
+  char default_passes[sizeof("default<O0>")];
+  if (!passes) {
+    snprintf(default_passes, sizeof(default_passes), "default<O%d>",
+             opt_level);
+    passes = default_passes;
+  }
+
+  // same tuning clang picks for the level
+  LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+  LLVMPassBuilderOptionsSetLoopUnrolling(options, opt_level > 0);
+  LLVMPassBuilderOptionsSetLoopVectorization(options, opt_level > 1);
+  LLVMPassBuilderOptionsSetSLPVectorization(options, opt_level > 1);
+
+  TimingScope timing = Timing_Begin("optimize", NULL);
+  LLVMErrorRef err = LLVMRunPasses(module, passes, machine, options);
+  Timing_End(timing);
+  LLVMDisposePassBuilderOptions(options);
+  if (err) {
+    char *message = LLVMGetErrorMessage(err);
+    Diagnostics_Error(diag, "Unable to run passes \"%s\": %s", passes,
+                      message);
+    LLVMDisposeErrorMessage(message);
+    return 1;
+  }
+  return 0;
+}
+
+int Backend_Emit(LLVMModuleRef module, LLVMTargetMachineRef machine,
+                 EmitKind kind, char *path, Diagnostics *diag) {
+  char *message = NULL;
+  LLVMBool failed = 1;
+  TimingScope timing = Timing_Begin("emit", NULL);
+
+  switch (kind) {
+  case EMIT_LL:
+    failed = LLVMPrintModuleToFile(module, path, &message);
+    break;
+  case EMIT_BC:
+    failed = LLVMWriteBitcodeToFile(module, path) != 0;
+    break;
+  case EMIT_ASM:
+  case EMIT_OBJ:
+    failed = LLVMTargetMachineEmitToFile(
+        machine, module, path,
+        kind == EMIT_ASM ? LLVMAssemblyFile : LLVMObjectFile, &message);
+    break;
+  }
+  Timing_End(timing);
+
+  struct stat written;
+  if (failed) {
+    Diagnostics_Error(diag, "Unable to write %s: %s", path,
+                      message ? message : "I/O error");
+  } else if (timing_enabled && stat(path, &written) == 0) {
+    Timing_Count(TIMING_BYTES_WRITTEN, written.st_size);
+  }
+  LLVMDisposeMessage(message);
+  return failed ? 1 : 0;
+}
+
+int Backend_EmitToMemory(LLVMModuleRef module, LLVMTargetMachineRef machine,
+                         EmitKind kind, char **bytes, size_t *len,
+                         Diagnostics *diag) {
+  char *message = NULL;
+  LLVMMemoryBufferRef buffer = NULL;
+  LLVMBool failed = 1;
+  TimingScope timing = Timing_Begin("emit", NULL);
+
+  switch (kind) {
+  case EMIT_LL: {
+    char *text = LLVMPrintModuleToString(module);
+    *len = strlen(text);
+    *bytes = malloc(*len + 1);
+    if (*bytes) {
+      memcpy(*bytes, text, *len + 1);
+      failed = 0;
+    }
+    LLVMDisposeMessage(text);
+    break;
+  }
+  case EMIT_BC:
+    buffer = LLVMWriteBitcodeToMemoryBuffer(module);
+    failed = buffer == NULL;
+    break;
+  case EMIT_ASM:
+  case EMIT_OBJ:
+    failed = LLVMTargetMachineEmitToMemoryBuffer(
+        machine, module, kind == EMIT_ASM ? LLVMAssemblyFile : LLVMObjectFile,
+        &message, &buffer);
+    break;
+  }
+
+  if (buffer) {
+    *len = LLVMGetBufferSize(buffer);
+    *bytes = malloc(*len + 1);
+    if (*bytes) {
+      memcpy(*bytes, LLVMGetBufferStart(buffer), *len);
+      (*bytes)[*len] = 0;
+    } else {
+      failed = 1;
+    }
+    LLVMDisposeMemoryBuffer(buffer);
+  }
+  Timing_End(timing);
+
+  if (failed) {
+    Diagnostics_Error(diag, "Unable to emit the module: %s",
+                      message ? message : "out of memory");
+  } else {
+    Timing_Count(TIMING_BYTES_WRITTEN, *len);
+  }
+  LLVMDisposeMessage(message);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#ifndef SML_BACKEND
+#define SML_BACKEND
+
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/Types.h>
+
+#include "diag.h"
+
+// Highest level accepted by -O
+#define SML_OPT_LEVEL_MAX 3
+
+typedef enum EmitKind {
+  EMIT_LL = 1, // textual IR
+  EMIT_BC,     // bitcode
+  EMIT_ASM,    // native assembly
+  EMIT_OBJ,    // native object file
+} EmitKind;
+
+// Returns non-zero if name isn't one of ll, bc, asm or obj
+int Backend_EmitKindFromName(const char *name, EmitKind *kind);
+// File extension, with the dot, for output of the given kind
+const char *Backend_EmitExtension(EmitKind kind);
+
+// Initialize the native target and its asm printer, safe to call from any
+// thread any number of times. Non-zero, after reporting it in diag, if
+// unavailable.
+int Backend_InitNative(Diagnostics *diag);
+
+// Target machine for the host's default triple, NULL after reporting why in
+// diag if the native target is unavailable. Dispose with
+// LLVMDisposeTargetMachine.
+// cpu NULL means generic, "native" the host CPU along with all of its
+// features. features is an -mattr style list (+avx2,-fma) applied on top,
+// may be NULL.
+LLVMTargetMachineRef Backend_NewTargetMachine(int opt_level, const char *cpu,
+                                              const char *features,
+                                              Diagnostics *diag);
+
+// Stamp the machine's triple and data layout on the module, before any
+// passes run so they can rely on them
+void Backend_SetTarget(LLVMModuleRef module, LLVMTargetMachineRef machine);
+
+// Returns non-zero, after reporting why in diag, if the module isn't well
+// formed
+int Backend_Verify(LLVMModuleRef module, Diagnostics *diag);
+
+// Optimize the module in-process with the new pass manager. passes is a
+// pipeline in `opt -passes=` syntax, NULL selects default<O{opt_level}>.
+// The module is verified first since passes assume valid IR; at -O0 without
+// a pipeline nothing runs at all. machine may be NULL. Failures are
+// reported in diag.
+int Backend_Optimize(LLVMModuleRef module, LLVMTargetMachineRef machine,
+                     int opt_level, const char *passes, Diagnostics *diag);
+
+// Write the module to path in the given form, non-zero after reporting why
+// in diag on failure
+int Backend_Emit(LLVMModuleRef module, LLVMTargetMachineRef machine,
+                 EmitKind kind, char *path, Diagnostics *diag);
+// Same, into a malloc'd buffer the caller frees. Textual kinds are
+// NUL-terminated, the terminator isn't counted in len.
+int Backend_EmitToMemory(LLVMModuleRef module, LLVMTargetMachineRef machine,
+                         EmitKind kind, char **bytes, size_t *len,
+                         Diagnostics *diag);
+
+#endif
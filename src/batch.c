@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "backend.h"
+#include "batch.h"
+#include "mem.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include "worker.h"
+
+typedef struct BatchFile {
+  const SmlArgs *args;
+  char *source;
+  off_t size;
+  int status;
+  char *diagnostics; // NULL when there are none
+} BatchFile;
+
+static void batch_task(void *arg);
+static int compare_sizes(const void *a, const void *b);
+
+int Batch_Compile(const SmlArgs *args) {
+  BatchFile *files = calloc(args->source_count, sizeof(BatchFile));
+  BatchFile **order = malloc(sizeof(BatchFile *) * args->source_count);
+  if (!files || !order) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  for (size_t i = 0; i < args->source_count; ++i) {
+    struct stat st;
+    files[i] = (BatchFile){
+        .args = args,
+        .source = args->source_files[i],
+        .size = stat(args->source_files[i], &st) == 0 ? st.st_size : 0,
+    };
+    order[i] = &files[i];
+  }
+
+  // the largest files start first so no thread is left with a big one at
+  // the end; the order they finish in doesn't show in the output
+  qsort(order, args->source_count, sizeof(BatchFile *), compare_sizes);
+  ThreadPool *pool = ThreadPool_New(0);
+  for (size_t i = 0; i < args->source_count; ++i) {
+    ThreadPool_Submit(pool, batch_task, order[i]);
+  }
+  ThreadPool_Wait(pool);
+  ThreadPool_Free(pool);
+
+  size_t failed = 0;
+  for (size_t i = 0; i < args->source_count; ++i) {
+    BatchFile *file = &files[i];
+    if (file->diagnostics) {
+      fputs(file->diagnostics, stderr);
+    }
+    failed += file->status != 0;
+    free(file->diagnostics);
+  }
+  if (failed) {
+    fprintf(stderr, "sml: %zu of %zu files failed\n", failed,
+            args->source_count);
+  }
+
+  free(order);
+  free(files);
+  return failed ? 1 : 0;
+}
+
+static void batch_task(void *arg) {
+  BatchFile *file = arg;
+  CompileWorker *worker = CompileWorker_ForThread();
+  char *output =
+      change_file_ext(file->source, Backend_EmitExtension(file->args->emit));
+  file->status = CompileWorker_CompileFile(worker, file->args, file->source,
+                                           file->source, output);
+  // the worker's diagnostics are cleared by its next file
+  if (worker->compiler.diag.len) {
+    file->diagnostics = strdup(worker->compiler.diag.text);
+  }
+  Mem_Free(output);
+}
+
+static int compare_sizes(const void *a, const void *b) {
+  const BatchFile *x = *(BatchFile *const *)a, *y = *(BatchFile *const *)b;
+  if (x->size != y->size) {
+    return x->size > y->size ? -1 : 1;
+  }
+  // ties in input order, qsort isn't stable
+  return x < y ? -1 : x > y;
+}
@@ -0,0 +1,12 @@
+#ifndef SML_BATCH
+#define SML_BATCH
+
+#include "options.h"
+
+// Compile every source of args on all cores, each to the source's name with
+// the extension of the output kind. A failing file doesn't stop the others;
+// diagnostics are printed in the order the files were given, each naming its
+// file. Non-zero if any file failed.
+int Batch_Compile(const SmlArgs *args);
+
+#endif
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bytecode.h"
+#include "mem.h"
+#include "stdlib.h"
+#include "utils.h"
+
+#define BC_VEC_MIN_CAP 16
+
+// Make room for one more item of the vector at items, returns its index
+#define BC_VEC_PUSH(items, count, capacity, value)                             \
+  (bc_vec_grow((void **)&(items), (count), &(capacity), sizeof(*(items))),     \
+   (items)[(count)] = (value), (count)++)
+
+static void bc_vec_grow(void **items, uint32_t count, uint32_t *capacity,
+                        size_t item_size) {
+  if (count < *capacity) {
+    return;
+  }
+  uint32_t new_capacity = *capacity ? *capacity * 2 : BC_VEC_MIN_CAP;
+  void *grown = realloc(*items, item_size * new_capacity);
+  if (!grown) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  *items = grown;
+  *capacity = new_capacity;
+}
+
+// Expression work stack, walked like llvm_emit_stmt_expr: step counts the
+// children already compiled. types holds the type of every live register,
+// depth of them, the next free register being depth itself.
+typedef struct BcFrame {
+  ExprId id;
+  uint32_t step;
+} BcFrame;
+
+typedef struct BcCompiler {
+  const AST *ast;
+  Bytecode *bc;
+  BcFunction *fn;
+  StdLib *stdlib;
+
+  BcFrame *frames;
+  uint32_t frame_count, frame_capacity;
+  Type *types;
+  uint32_t depth, type_capacity;
+} BcCompiler;
+
+static int bc_compile_function(BcCompiler *, BcFunction *);
+static int bc_compile_global(BcCompiler *, const StmtVarDecl *);
+static int bc_compile_expr(BcCompiler *, ExprId, Type *type);
+static int bc_compile_call(BcCompiler *, const ExprCall *);
+static int bc_compile_ident(BcCompiler *, const ExprIdent *);
+static void bc_emit(BcCompiler *, OpCode, uint32_t a, uint32_t b, uint32_t c);
+static void bc_push_type(BcCompiler *, Type);
+static int32_t bc_find_global(const Bytecode *, const char *name);
+
+int Bytecode_Compile(Bytecode *bc, const AST *ast) {
+  memset(bc, 0, sizeof(Bytecode));
+  BcCompiler c;
+  memset(&c, 0, sizeof(BcCompiler));
+  c.ast = ast;
+  c.bc = bc;
+  init_std_lib(&c.stdlib);
+
+  // functions are known up front so calls may precede the callee, globals
+  // only from their declaration on, as in llvm_gen
+  uint32_t fn_capacity = 0, global_capacity = 0;
+  for (uint32_t i = 0; i < ast->root.stmt_count; ++i) {
+    const StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, ast->root, i)];
+    if (stmt->type == STMT_FN_DECL) {
+      const StmtFnDecl *decl = &ast->fn_decls.items[stmt->index];
+      if (Bytecode_FindFunction(bc, decl->name) >= 0) {
+        fprintf(stderr, "[Error] Redefinition of function %s\n", decl->name);
+        return 1;
+      }
+      BcFunction fn = {.decl = decl};
+      BC_VEC_PUSH(bc->fns, bc->fn_count, fn_capacity, fn);
+    } else if (stmt->type == STMT_VAR_DECL) {
+      global_capacity++;
+    }
+  }
+  bc->global_names = malloc(sizeof(char *) * (global_capacity + 1));
+  bc->global_types = malloc(sizeof(Type) * (global_capacity + 1));
+
+  int status = 0;
+  uint32_t fn_index = 0;
+  for (uint32_t i = 0; i < ast->root.stmt_count && status == 0; ++i) {
+    const StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, ast->root, i)];
+    switch (stmt->type) {
+    case STMT_FN_DECL:
+      status = bc_compile_function(&c, &bc->fns[fn_index++]);
+      break;
+    case STMT_VAR_DECL:
+      status = bc_compile_global(&c, &ast->var_decls.items[stmt->index]);
+      break;
+    default:
+      fprintf(stderr, "[Error] Only declarations are allowed at global "
+                      "scope\n");
+      status = 1;
+    }
+  }
+
+  // the initializers return to whoever ran them
+  c.fn = &bc->init;
+  bc_emit(&c, OP_RET, 0, 0, 0);
+  if (bc->init.reg_count == 0) {
+    bc->init.reg_count = 1;
+  }
+
+  free(c.frames);
+  free(c.types);
+  return status;
+}
+
+int32_t Bytecode_FindFunction(const Bytecode *bc, const char *name) {
+  for (uint32_t i = 0; i < bc->fn_count; ++i) {
+    if (strcmp(bc->fns[i].decl->name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void bc_free_function(BcFunction *fn) {
+  free(fn->code);
+  free(fn->callees);
+}
+
+void Bytecode_Free(Bytecode *bc) {
+  for (uint32_t i = 0; i < bc->fn_count; ++i) {
+    bc_free_function(&bc->fns[i]);
+  }
+  bc_free_function(&bc->init);
+  for (uint32_t i = 0; i < bc->string_count; ++i) {
+    Mem_Free(bc->strings[i]);
+  }
+  free(bc->fns);
+  free(bc->global_names);
+  free(bc->global_types);
+  free(bc->strings);
+  memset(bc, 0, sizeof(Bytecode));
+}
+
+// The body must end in a return of the declared type, and nothing may follow
+// it: LLVM would reject the function otherwise
+static int bc_compile_function(BcCompiler *c, BcFunction *fn) {
+  const StmtFnDecl *decl = fn->decl;
+  const AST *ast = c->ast;
+  c->fn = fn;
+
+  bool returned = false;
+  for (uint32_t i = 0; i < decl->body.stmt_count; ++i) {
+    const StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, decl->body, i)];
+    if (returned) {
+      fprintf(stderr, "[Error] Unreachable code after return in %s\n",
+              decl->name);
+      return 1;
+    }
+
+    Type type;
+    switch (stmt->type) {
+    case STMT_RETURN:
+      if (bc_compile_expr(c, ast->returns.items[stmt->index].operand, &type) !=
+          0) {
+        return 1;
+      }
+      if (type != decl->return_type) {
+        fprintf(stderr, "[Error] %s returns %s but is declared %s\n",
+                decl->name, TYPE(type), TYPE(decl->return_type));
+        return 1;
+      }
+      bc_emit(c, OP_RET, 0, 0, 0);
+      returned = true;
+      break;
+    case STMT_EXPR:
+      if (bc_compile_expr(c, stmt->index, &type) != 0) {
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, "[Error] Declarations are not allowed inside %s\n",
+              decl->name);
+      return 1;
+    }
+  }
+
+  if (!returned) {
+    fprintf(stderr, "[Error] %s must end with a return\n", decl->name);
+    return 1;
+  }
+  return 0;
+}
+
+static int bc_compile_global(BcCompiler *c, const StmtVarDecl *var_decl) {
+  c->fn = &c->bc->init;
+  Type type;
+  if (bc_compile_expr(c, var_decl->init, &type) != 0) {
+    return 1;
+  }
+
+  Bytecode *bc = c->bc;
+  bc->global_names[bc->global_count] = var_decl->name;
+  bc->global_types[bc->global_count] = type;
+  bc_emit(c, OP_SET_GLOBAL, bc->global_count++, 0, 0);
+  return 0;
+}
+
+/*
+ * Post-order walk with an explicit stack, so deeply nested expressions can't
+ * overflow the machine stack. The value lands in register 0.
+ */
+static int bc_compile_expr(BcCompiler *c, ExprId id, Type *type) {
+  const AST *ast = c->ast;
+  c->frame_count = 0;
+  c->depth = 0;
+  BcFrame root = {.id = id};
+  BC_VEC_PUSH(c->frames, c->frame_count, c->frame_capacity, root);
+
+  while (c->frame_count > 0) {
+    BcFrame *frame = &c->frames[c->frame_count - 1];
+    const ExprNode *expr = &ast->exprs.items[frame->id];
+
+    switch (expr->type) {
+    case EXPR_LITERAL: {
+      const ExprLiteral *literal = &ast->literals.items[expr->index];
+      if (literal->type == EXPR_LITERAL_NUM) {
+        bc_emit(c, OP_INT, c->depth, (uint32_t)(int32_t)literal->value.number,
+                0);
+        bc_push_type(c, TYPE_INT);
+        break;
+      }
+      Bytecode *bc = c->bc;
+      char *str = unescape_str(literal->value.string);
+      BC_VEC_PUSH(bc->strings, bc->string_count, bc->string_capacity, str);
+      bc_emit(c, OP_STR, c->depth, bc->string_count - 1, 0);
+      bc_push_type(c, TYPE_STR);
+      break;
+    }
+    case EXPR_IDENT:
+      if (bc_compile_ident(c, &ast->idents.items[expr->index]) != 0) {
+        return 1;
+      }
+      break;
+    case EXPR_CALL: {
+      const ExprCall *call = &ast->calls.items[expr->index];
+      if (frame->step < call->argc) {
+        BcFrame arg = {.id = AST_CallArg(ast, call, frame->step++)};
+        BC_VEC_PUSH(c->frames, c->frame_count, c->frame_capacity, arg);
+        continue;
+      }
+      if (bc_compile_call(c, call) != 0) {
+        return 1;
+      }
+      break;
+    }
+    case EXPR_BINOP: {
+      const ExprBinOp *binop = &ast->binops.items[expr->index];
+      if (frame->step < 2) {
+        BcFrame operand = {.id = frame->step++ ? binop->rhs : binop->lhs};
+        BC_VEC_PUSH(c->frames, c->frame_count, c->frame_capacity, operand);
+        continue;
+      }
+      c->depth -= 2;
+      if (c->types[c->depth] != TYPE_INT ||
+          c->types[c->depth + 1] != TYPE_INT) {
+        fprintf(stderr, "[Error] Operands of + must be int\n");
+        return 1;
+      }
+      bc_emit(c, OP_ADD, c->depth, c->depth, c->depth + 1);
+      bc_push_type(c, TYPE_INT);
+      break;
+    }
+    }
+
+    c->frame_count--;
+  }
+
+  *type = c->types[0];
+  return 0;
+}
+
+// The arguments are the topmost argc registers
+static int bc_compile_call(BcCompiler *c, const ExprCall *call) {
+  c->depth -= call->argc;
+  uint32_t dst = c->depth;
+  if (c->fn == &c->bc->init) {
+    fprintf(stderr, "[Error] Globals must be initialized with a constant\n");
+    return 1;
+  }
+
+  BuiltinFn *builtin = find_builtin_fn(c->stdlib, call->name);
+  if (builtin) {
+    // print is the only builtin
+    if (builtin->prototype.param_count != call->argc) {
+      fprintf(stderr, "[Error] %s takes %zu arguments\n", call->name,
+              builtin->prototype.param_count);
+      return 1;
+    }
+    if (c->types[dst] != TYPE_STR) {
+      fprintf(stderr, "[Error] %s expects a str\n", call->name);
+      return 1;
+    }
+    bc_emit(c, OP_PRINT, dst, dst, 0);
+    bc_push_type(c, builtin->prototype.return_type);
+    return 0;
+  }
+
+  int32_t callee = Bytecode_FindFunction(c->bc, call->name);
+  if (callee < 0) {
+    fprintf(stderr, "[Error] Call to undefined function %s\n", call->name);
+    return 1;
+  }
+  if (call->argc != 0) {
+    fprintf(stderr, "[Error] Function %s takes no arguments\n", call->name);
+    return 1;
+  }
+
+  BcFunction *fn = c->fn;
+  uint32_t i = 0;
+  while (i < fn->callee_count && fn->callees[i] != (uint32_t)callee) {
+    i++;
+  }
+  if (i == fn->callee_count) {
+    BC_VEC_PUSH(fn->callees, fn->callee_count, fn->callee_capacity,
+                (uint32_t)callee);
+  }
+
+  bc_emit(c, OP_CALL, dst, callee, 0);
+  bc_push_type(c, c->bc->fns[callee].decl->return_type);
+  return 0;
+}
+
+static int bc_compile_ident(BcCompiler *c, const ExprIdent *ident) {
+  int32_t global = bc_find_global(c->bc, ident->label);
+  if (global < 0) {
+    fprintf(stderr, "[Error] Undefined variable %s\n", ident->label);
+    return 1;
+  }
+  bc_emit(c, OP_GLOBAL, c->depth, global, 0);
+  bc_push_type(c, c->bc->global_types[global]);
+  return 0;
+}
+
+static void bc_emit(BcCompiler *comp, OpCode op, uint32_t a, uint32_t b,
+                    uint32_t c) {
+  BcFunction *fn = comp->fn;
+  Instr instr = {.op = op, .a = a, .b = b, .c = c};
+  BC_VEC_PUSH(fn->code, fn->code_count, fn->code_capacity, instr);
+}
+
+static void bc_push_type(BcCompiler *c, Type type) {
+  BC_VEC_PUSH(c->types, c->depth, c->type_capacity, type);
+  if (c->depth > c->fn->reg_count) {
+    c->fn->reg_count = c->depth;
+  }
+}
+
+// The first declaration wins, like LLVMGetNamedGlobal
+static int32_t bc_find_global(const Bytecode *bc, const char *name) {
+  for (uint32_t i = 0; i < bc->global_count; ++i) {
+    if (strcmp(bc->global_names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
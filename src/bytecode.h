@@ -0,0 +1,77 @@
+#ifndef SML_BYTECODE
+#define SML_BYTECODE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "type.h"
+
+/*
+ * Tier-0 register bytecode. Every function gets a frame of reg_count value
+ * registers; an expression's operands are evaluated into consecutive
+ * registers and its result replaces the first of them, so call arguments
+ * always sit next to each other. Operands are typed at compile time and the
+ * interpreter never checks them again.
+ */
+
+typedef enum OpCode {
+  OP_INT = 1,      // a = b, an int32 immediate
+  OP_STR,          // a = strings[b]
+  OP_GLOBAL,       // a = globals[b]
+  OP_SET_GLOBAL,   // globals[a] = b
+  OP_ADD,          // a = b + c
+  OP_PRINT,        // a = printf(b)
+  OP_CALL,         // a = fns[b](), interpreted
+  OP_CALL_NATIVE,  // a = fns[b](), patched in once fns[b] is compiled
+  OP_RET,          // return a
+} OpCode;
+
+typedef struct Instr {
+  uint8_t op; // OpCode
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+} Instr;
+
+typedef union Value {
+  int32_t i;
+  const char *s;
+} Value;
+
+typedef struct BcFunction {
+  const StmtFnDecl *decl; // NULL for the global initializers
+  Instr *code;
+  uint32_t code_count, code_capacity;
+  uint32_t reg_count;
+  // distinct functions called, read by the background compiler
+  uint32_t *callees;
+  uint32_t callee_count, callee_capacity;
+
+  uint32_t calls; // tier-0 invocations
+  bool queued;    // promotion requested
+  bool jitted;    // handed to the JIT, owned by the compiler thread
+  void *native;   // compiled code, published with a release store
+} BcFunction;
+
+typedef struct Bytecode {
+  BcFunction *fns; // in declaration order
+  uint32_t fn_count;
+  BcFunction init; // global initializers, in declaration order
+
+  const char **global_names;
+  Type *global_types;
+  uint32_t global_count;
+
+  char **strings; // unescaped literals
+  uint32_t string_count, string_capacity;
+} Bytecode;
+
+// Compile every function and global of the program. Non-zero, after
+// reporting why, for programs the LLVM code generator would reject too.
+int Bytecode_Compile(Bytecode *bc, const AST *ast);
+// -1 if the program has no such function
+int32_t Bytecode_FindFunction(const Bytecode *bc, const char *name);
+void Bytecode_Free(Bytecode *bc);
+
+#endif
@@ -0,0 +1,262 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <llvm-c/Core.h>
+
+#include "cache.h"
+
+#define CACHE_ENTRY_SUFFIX ".bc"
+#define CACHE_TMP_PREFIX "tmp."
+// A temporary file this old belongs to a writer that died
+#define CACHE_TMP_STALE_SECONDS 3600
+
+typedef struct CacheEntry {
+  char *name;
+  off_t size;
+  struct timespec mtime;
+} CacheEntry;
+
+static char *cache_path(const Cache *, const char *name);
+static void cache_entry_name(CacheHash key, char *name);
+static int make_dirs(char *path);
+static int compare_entries(const void *a, const void *b);
+
+CacheHash CacheHash_New(void) {
+  CacheHash hash;
+  hash.state = ((unsigned __int128)0x6c62272e07bb0142ULL << 64) |
+               0x62b821756295c58dULL;
+  return hash;
+}
+
+void CacheHash_Bytes(CacheHash *hash, const void *data, size_t len) {
+  const unsigned __int128 prime =
+      ((unsigned __int128)0x0000000001000000ULL << 64) | 0x000000000000013bULL;
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < len; ++i) {
+    hash->state ^= bytes[i];
+    hash->state *= prime;
+  }
+}
+
+void CacheHash_String(CacheHash *hash, const char *string) {
+  CacheHash_Bytes(hash, string, strlen(string) + 1);
+}
+
+void CacheHash_U64(CacheHash *hash, uint64_t value) {
+  CacheHash_Bytes(hash, &value, sizeof(value));
+}
+
+char *Cache_DefaultDir(void) {
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  char *dir;
+  if (xdg && *xdg) {
+    dir = malloc(strlen(xdg) + sizeof("/sml"));
+    if (dir) {
+      sprintf(dir, "%s/sml", xdg);
+    }
+  } else {
+    dir = malloc(strlen(home ? home : "/tmp") + sizeof("/.cache/sml"));
+    if (dir) {
+      sprintf(dir, "%s/.cache/sml", home ? home : "/tmp");
+    }
+  }
+  if (!dir) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  return dir;
+}
+
+int Cache_Open(Cache *cache, const char *dir, size_t size_cap) {
+  memset(cache, 0, sizeof(Cache));
+  cache->dir = strdup(dir);
+  cache->size_cap = size_cap;
+  if (!cache->dir) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  if (make_dirs(cache->dir) != 0) {
+    fprintf(stderr, "[Error] Unable to create the cache directory %s: %s\n",
+            dir, strerror(errno));
+    free(cache->dir);
+    cache->dir = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+LLVMMemoryBufferRef Cache_Load(Cache *cache, CacheHash key) {
+  char name[64];
+  cache_entry_name(key, name);
+  char *path = cache_path(cache, name);
+
+  LLVMMemoryBufferRef buffer = NULL;
+  char *message = NULL;
+  // the entry may have been evicted by another process since, a miss too
+  if (access(path, R_OK) != 0 ||
+      LLVMCreateMemoryBufferWithContentsOfFile(path, &buffer, &message)) {
+    LLVMDisposeMessage(message);
+    buffer = NULL;
+    cache->stats.misses++;
+  } else {
+    utimensat(AT_FDCWD, path, NULL, 0);
+    cache->stats.hits++;
+  }
+  free(path);
+  return buffer;
+}
+
+void Cache_Store(Cache *cache, CacheHash key, const void *data, size_t len) {
+  char name[64];
+  cache_entry_name(key, name);
+  char *path = cache_path(cache, name);
+
+  // unique among the processes and threads writing the same entry
+  char tmp_name[128];
+  snprintf(tmp_name, sizeof(tmp_name), CACHE_TMP_PREFIX "%ld.%lx.%s",
+           (long)getpid(), (unsigned long)pthread_self(), name);
+  char *tmp_path = cache_path(cache, tmp_name);
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    const char *bytes = data;
+    size_t left = len;
+    while (left > 0) {
+      ssize_t written = write(fd, bytes, left);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        break;
+      }
+      bytes += written;
+      left -= written;
+    }
+    if (close(fd) == 0 && left == 0 && rename(tmp_path, path) == 0) {
+      cache->stats.stored += len;
+    } else {
+      unlink(tmp_path);
+    }
+  }
+  free(tmp_path);
+  free(path);
+}
+
+void Cache_Evict(Cache *cache) {
+  DIR *dir = opendir(cache->dir);
+  if (!dir) {
+    return;
+  }
+
+  CacheEntry *entries = NULL;
+  size_t count = 0, capacity = 0;
+  size_t total = 0;
+  time_t now = time(NULL);
+  struct dirent *dirent;
+  while ((dirent = readdir(dir))) {
+    const char *name = dirent->d_name;
+    bool is_tmp = strncmp(name, CACHE_TMP_PREFIX,
+                          sizeof(CACHE_TMP_PREFIX) - 1) == 0;
+    size_t len = strlen(name);
+    bool is_entry = len > sizeof(CACHE_ENTRY_SUFFIX) - 1 &&
+                    strcmp(name + len - (sizeof(CACHE_ENTRY_SUFFIX) - 1),
+                           CACHE_ENTRY_SUFFIX) == 0;
+    if (!is_tmp && !is_entry) {
+      continue;
+    }
+    struct stat st;
+    if (fstatat(dirfd(dir), name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    if (is_tmp) {
+      if (now - st.st_mtime > CACHE_TMP_STALE_SECONDS) {
+        unlinkat(dirfd(dir), name, 0);
+      }
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      entries = realloc(entries, sizeof(CacheEntry) * capacity);
+      if (!entries) {
+        perror("Unable to allocate memory");
+        exit(1);
+      }
+    }
+    entries[count++] = (CacheEntry){
+        .name = strdup(name), .size = st.st_size, .mtime = st.st_mtim};
+    total += st.st_size;
+  }
+
+  // oldest first
+  qsort(entries, count, sizeof(CacheEntry), compare_entries);
+  for (size_t i = 0; i < count; ++i) {
+    if (total > cache->size_cap &&
+        unlinkat(dirfd(dir), entries[i].name, 0) == 0) {
+      total -= entries[i].size;
+      cache->stats.evicted++;
+    }
+    free(entries[i].name);
+  }
+  free(entries);
+  closedir(dir);
+}
+
+void Cache_Close(Cache *cache) {
+  free(cache->dir);
+  cache->dir = NULL;
+}
+
+static char *cache_path(const Cache *cache, const char *name) {
+  char *path = malloc(strlen(cache->dir) + strlen(name) + 2);
+  if (!path) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  sprintf(path, "%s/%s", cache->dir, name);
+  return path;
+}
+
+static void cache_entry_name(CacheHash key, char *name) {
+  sprintf(name, "%016llx%016llx" CACHE_ENTRY_SUFFIX,
+          (unsigned long long)(key.state >> 64),
+          (unsigned long long)key.state);
+}
+
+// mkdir -p, path is restored before returning
+static int make_dirs(char *path) {
+  for (char *slash = strchr(path + 1, '/'); slash;
+       slash = strchr(slash + 1, '/')) {
+    *slash = 0;
+    int status = mkdir(path, 0755);
+    *slash = '/';
+    if (status != 0 && errno != EEXIST) {
+      return 1;
+    }
+  }
+  if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+    return 1;
+  }
+  return 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  const struct timespec *x = &((const CacheEntry *)a)->mtime;
+  const struct timespec *y = &((const CacheEntry *)b)->mtime;
+  if (x->tv_sec != y->tv_sec) {
+    return x->tv_sec < y->tv_sec ? -1 : 1;
+  }
+  if (x->tv_nsec != y->tv_nsec) {
+    return x->tv_nsec < y->tv_nsec ? -1 : 1;
+  }
+  return 0;
+}
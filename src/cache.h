@@ -0,0 +1,58 @@
+#ifndef SML_CACHE
+#define SML_CACHE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <llvm-c/Types.h>
+
+// Bump when the cached bitcode would change for the same source and flags
+#define SML_CACHE_FORMAT 1
+// Default size cap, --cache-size changes it
+#define SML_CACHE_SIZE_MB 256
+
+// 128-bit FNV-1a, keys are content addresses so 64 bits would be too few
+typedef struct CacheHash {
+  unsigned __int128 state;
+} CacheHash;
+
+CacheHash CacheHash_New(void);
+void CacheHash_Bytes(CacheHash *, const void *data, size_t len);
+// Hashes the terminator too, so "ab" "c" differs from "a" "bc"
+void CacheHash_String(CacheHash *, const char *string);
+void CacheHash_U64(CacheHash *, uint64_t value);
+
+typedef struct CacheStats {
+  size_t hits;
+  size_t misses;
+  size_t stored;  // bytes written
+  size_t evicted; // entries removed to stay under the cap
+} CacheStats;
+
+/*
+ * On-disk cache of per-declaration build products: one file per key, named
+ * after it, in a flat directory. Writes go to a temporary file renamed into
+ * place, so any number of processes can share the directory; a reader sees
+ * a whole entry or none. Hits refresh the entry's mtime, which is what LRU
+ * eviction sorts on.
+ */
+typedef struct Cache {
+  char *dir;
+  size_t size_cap; // bytes
+  CacheStats stats;
+} Cache;
+
+// $XDG_CACHE_HOME/sml, else ~/.cache/sml. Free the result.
+char *Cache_DefaultDir(void);
+// Creates dir, and its parents, if needed. Non-zero after reporting why.
+int Cache_Open(Cache *, const char *dir, size_t size_cap);
+// NULL on a miss; dispose with LLVMDisposeMemoryBuffer
+LLVMMemoryBufferRef Cache_Load(Cache *, CacheHash key);
+// Failing to store only costs a later miss, so it isn't reported
+void Cache_Store(Cache *, CacheHash key, const void *data, size_t len);
+// Remove the least recently used entries until the cache fits its cap
+void Cache_Evict(Cache *);
+void Cache_Close(Cache *);
+
+#endif
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "arena.h"
+#include "compiler.h"
+#include "fold.h"
+#include "lexer.h"
+#include "llvm_gen.h"
+#include "mem.h"
+#include "parser.h"
+#include "timing.h"
+#include "type_check.h"
+
+void SmlCompiler_Init(SmlCompiler *compiler, LLVMContextRef context,
+                      FILE *echo) {
+  memset(compiler, 0, sizeof(SmlCompiler));
+  compiler->owns_context = context == NULL;
+  compiler->context = context ? context : LLVMContextCreate();
+  compiler->diag = Diagnostics_New(echo);
+  compiler->global_linkage = LLVMExternalLinkage;
+  init_std_lib(&compiler->stdlib);
+  size_t builtin_count = compiler->stdlib->builtin_fns_count;
+  size_t decls_size = sizeof(LLVMValueRef) * (builtin_count + 1);
+  size_t types_size = sizeof(LLVMTypeRef) * (builtin_count + 1);
+  compiler->builtin_decls = Mem_Alloc(decls_size);
+  compiler->builtin_types = Mem_Alloc(types_size);
+  if (!compiler->builtin_decls || !compiler->builtin_types) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  memset(compiler->builtin_decls, 0, decls_size);
+  memset(compiler->builtin_types, 0, types_size);
+}
+
+void SmlCompiler_Free(SmlCompiler *compiler) {
+  free_std_lib(compiler->stdlib);
+  Diagnostics_Free(&compiler->diag);
+  Mem_Free(compiler->builtin_decls);
+  Mem_Free(compiler->builtin_types);
+  Mem_Free(compiler->emit_strings);
+  Mem_Free(compiler->emit_frames);
+  Mem_Free(compiler->emit_values);
+  if (compiler->owns_context) {
+    LLVMContextDispose(compiler->context);
+  }
+  memset(compiler, 0, sizeof(SmlCompiler));
+}
+
+LLVMModuleRef SmlCompiler_CompileModule(SmlCompiler *compiler,
+                                        const char *buffer, size_t len,
+                                        char *name,
+                                        LLVMTargetMachineRef machine) {
+  Arena arena = Arena_New();
+  Parser parser = Parser_New(Lexer_New(buffer, len), &arena, &compiler->diag);
+  AST ast;
+  LLVMModuleRef module = NULL;
+  TimingScope timing = Timing_Begin("parse", NULL);
+  int status = Parse(&parser, &ast);
+  Timing_End(timing);
+  Timing_Count(TIMING_TOKENS, parser.token_count);
+  if (status == 0) {
+    Timing_Count(TIMING_AST_NODES, ast.exprs.count + ast.stmts.count);
+    timing = Timing_Begin("type check", NULL);
+    AST_type_check(&ast);
+    Timing_End(timing);
+    timing = Timing_Begin("fold", NULL);
+    AST_fold(&ast);
+    Timing_End(timing);
+    module = llvm_emit_module(compiler, &ast, name, machine);
+    AST_Free(&ast);
+  }
+  Lexer_Free(&parser.lexer);
+  Arena_Free(&arena);
+  return module;
+}
@@ -0,0 +1,69 @@
+#ifndef SML_COMPILER
+#define SML_COMPILER
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/Types.h>
+
+#include "ast.h"
+#include "diag.h"
+#include "stdlib.h"
+
+/*
+ * Everything one compilation needs besides its input: the LLVM context the
+ * module is created in, the standard library, diagnostics and the state of
+ * the code generator. Nothing is process-wide, so any number of compilers
+ * can run on different threads, and one compiler can be reused for any
+ * number of compilations one after the other.
+ */
+typedef struct SmlCompiler {
+  LLVMContextRef context;
+  bool owns_context;
+  StdLib *stdlib;
+  Diagnostics diag;
+
+  // codegen of the module being emitted, see llvm_gen.c
+  jmp_buf *bail;
+  const AST *ast;
+  LLVMModuleRef module;
+  LLVMBuilderRef builder;
+  LLVMAttributeRef target_cpu;
+  LLVMAttributeRef target_features;
+  const StmtFnDecl *const *defined_fns; // NULL: all of them
+  size_t defined_fn_count;
+  LLVMLinkage global_linkage;
+
+  // declarations of the builtins the module calls, by stdlib index, and
+  // its string literals, each emitted once per module
+  LLVMValueRef *builtin_decls;
+  LLVMTypeRef *builtin_types;
+  struct EmitString *emit_strings; // open addressing by contents
+  size_t emit_string_count, emit_string_capacity;
+
+  struct EmitFrame *emit_frames;
+  size_t emit_frame_count, emit_frame_capacity;
+  LLVMValueRef *emit_values;
+  size_t emit_value_count, emit_value_capacity;
+} SmlCompiler;
+
+// context NULL creates one owned by the compiler. Diagnostics are echoed to
+// echo as they are reported, when not NULL.
+void SmlCompiler_Init(SmlCompiler *compiler, LLVMContextRef context,
+                      FILE *echo);
+void SmlCompiler_Free(SmlCompiler *compiler);
+
+// Lex, parse, check and emit buffer, which need not be NUL-terminated, as a
+// module of the compiler's context with name as its source file name.
+// machine only provides target-cpu/target-features attributes and may be
+// NULL. NULL on error, the reasons are in compiler->diag.
+LLVMModuleRef SmlCompiler_CompileModule(SmlCompiler *compiler,
+                                        const char *buffer, size_t len,
+                                        char *name,
+                                        LLVMTargetMachineRef machine);
+
+#endif
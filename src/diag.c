@@ -0,0 +1,88 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diag.h"
+#include "mem.h"
+
+static void diag_reserve(Diagnostics *diag, size_t extra) {
+  if (diag->len + extra + 1 <= diag->capacity) {
+    return;
+  }
+  size_t capacity = diag->capacity ? diag->capacity : 256;
+  while (capacity < diag->len + extra + 1) {
+    capacity *= 2;
+  }
+  diag->text = Mem_Realloc(diag->text, capacity);
+  if (!diag->text) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  diag->capacity = capacity;
+}
+
+Diagnostics Diagnostics_New(FILE *echo) {
+  Diagnostics diag;
+  memset(&diag, 0, sizeof(Diagnostics));
+  diag.echo = echo;
+  return diag;
+}
+
+void Diagnostics_Error(Diagnostics *diag, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  va_list copy;
+  va_copy(copy, args);
+  int message_len = vsnprintf(NULL, 0, fmt, copy);
+  va_end(copy);
+
+  static const char prefix[] = "[Error] ";
+  size_t source_len = diag->source ? strlen(diag->source) + 2 : 0;
+  size_t line_len = source_len + sizeof(prefix) - 1 + message_len + 1;
+  diag_reserve(diag, line_len);
+  char *line = diag->text + diag->len;
+  if (diag->source) {
+    memcpy(line, diag->source, source_len - 2);
+    memcpy(line + source_len - 2, ": ", 2);
+  }
+  memcpy(line + source_len, prefix, sizeof(prefix) - 1);
+  vsnprintf(line + source_len + sizeof(prefix) - 1, message_len + 1, fmt,
+            args);
+  va_end(args);
+  line[line_len - 1] = '\n';
+  line[line_len] = 0;
+  diag->len += line_len;
+  diag->error_count++;
+
+  if (diag->echo) {
+    fwrite(line, 1, line_len, diag->echo);
+  }
+}
+
+void Diagnostics_Append(Diagnostics *diag, const Diagnostics *other) {
+  if (other->len == 0) {
+    return;
+  }
+  diag_reserve(diag, other->len);
+  memcpy(diag->text + diag->len, other->text, other->len + 1);
+  diag->len += other->len;
+  diag->error_count += other->error_count;
+
+  if (diag->echo) {
+    fwrite(other->text, 1, other->len, diag->echo);
+  }
+}
+
+void Diagnostics_Clear(Diagnostics *diag) {
+  diag->len = 0;
+  diag->error_count = 0;
+  if (diag->text) {
+    diag->text[0] = 0;
+  }
+}
+
+void Diagnostics_Free(Diagnostics *diag) {
+  Mem_Free(diag->text);
+  *diag = Diagnostics_New(diag->echo);
+}
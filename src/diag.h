@@ -0,0 +1,29 @@
+#ifndef SML_DIAG
+#define SML_DIAG
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Messages reported while compiling, kept as text so a library caller gets
+// them back instead of finding them on stderr. With echo set every message
+// is also written there as soon as it is reported.
+typedef struct Diagnostics {
+  char *text;
+  size_t len;
+  size_t capacity;
+  int error_count;
+  FILE *echo;
+  // when set, messages read "source: [Error] ..." to tell files apart
+  const char *source;
+} Diagnostics;
+
+Diagnostics Diagnostics_New(FILE *echo);
+// One "[Error] ..." line, fmt without the trailing newline
+void Diagnostics_Error(Diagnostics *, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+// Append everything other holds, echoed as if reported here
+void Diagnostics_Append(Diagnostics *, const Diagnostics *other);
+void Diagnostics_Clear(Diagnostics *);
+void Diagnostics_Free(Diagnostics *);
+
+#endif
@@ -0,0 +1,269 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fold.h"
+#include "mem.h"
+
+// A global defined so far; value is its initializer when that is a literal
+typedef struct FoldGlobal {
+  const char *name; // NULL for an empty slot
+  bool constant;
+  ExprNode value;
+} FoldGlobal;
+
+// Expression work stack, step counts the children already folded
+typedef struct FoldFrame {
+  ExprId id;
+  uint32_t step;
+} FoldFrame;
+
+typedef struct FoldContext {
+  AST *ast;
+  // open addressing, the first definition of a name wins as it does for
+  // LLVMGetNamedGlobal
+  FoldGlobal *globals;
+  size_t global_capacity;
+  FoldFrame *frames;
+  size_t frame_count, frame_capacity;
+  bool in_function; // string globals are only copied into other globals
+} FoldContext;
+
+static void fold_vardecl(FoldContext *, StmtVarDecl *);
+static void fold_function(FoldContext *, StmtFnDecl *);
+static void fold_expr(FoldContext *, ExprId);
+static void fold_ident(FoldContext *, ExprId);
+static void fold_binop(FoldContext *, ExprId);
+static bool fold_is_pure(FoldContext *, ExprId);
+static bool int_literal(const AST *, ExprId, int32_t *value);
+static FoldGlobal *fold_global(FoldContext *, const char *name);
+static void fold_push_frame(FoldContext *, ExprId);
+
+void AST_fold(AST *ast) {
+  FoldContext ctx = {.ast = ast};
+  ctx.global_capacity = 16;
+  while (ctx.global_capacity < (size_t)ast->var_decls.count * 2) {
+    ctx.global_capacity *= 2;
+  }
+  ctx.globals = Mem_Alloc(sizeof(FoldGlobal) * ctx.global_capacity);
+  if (!ctx.globals) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  memset(ctx.globals, 0, sizeof(FoldGlobal) * ctx.global_capacity);
+
+  // in source order, codegen only sees the globals defined before a use
+  for (uint32_t i = 0; i < ast->root.stmt_count; ++i) {
+    StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, ast->root, i)];
+    switch (stmt->type) {
+    case STMT_VAR_DECL:
+      fold_vardecl(&ctx, &ast->var_decls.items[stmt->index]);
+      break;
+    case STMT_FN_DECL:
+      fold_function(&ctx, &ast->fn_decls.items[stmt->index]);
+      break;
+    }
+  }
+
+  Mem_Free(ctx.globals);
+  Mem_Free(ctx.frames);
+}
+
+static void fold_vardecl(FoldContext *ctx, StmtVarDecl *var_decl) {
+  ctx->in_function = false;
+  fold_expr(ctx, var_decl->init);
+
+  const ExprNode *init = &ctx->ast->exprs.items[var_decl->init];
+  if (init->type == EXPR_LITERAL) {
+    // type checking only knew literals
+    var_decl->type = ctx->ast->literals.items[init->index].type ==
+                             EXPR_LITERAL_NUM
+                         ? TYPE_INT
+                         : TYPE_STR;
+  }
+  FoldGlobal *global = fold_global(ctx, var_decl->name);
+  if (!global->name) {
+    global->name = var_decl->name;
+    global->constant = init->type == EXPR_LITERAL;
+    global->value = *init;
+  }
+}
+
+// Folds every statement, then compacts the body over the dropped ones
+static void fold_function(FoldContext *ctx, StmtFnDecl *decl) {
+  AST *ast = ctx->ast;
+  ctx->in_function = true;
+  StmtId *body = ast->block_stmts.items + decl->body.start;
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < decl->body.stmt_count; ++i) {
+    StmtNode *stmt = &ast->stmts.items[body[i]];
+    if (stmt->type == STMT_RETURN) {
+      fold_expr(ctx, ast->returns.items[stmt->index].operand);
+    } else if (stmt->type == STMT_EXPR) {
+      fold_expr(ctx, stmt->index);
+      if (fold_is_pure(ctx, stmt->index)) {
+        continue;
+      }
+    }
+    body[kept++] = body[i];
+  }
+  decl->body.stmt_count = kept;
+}
+
+/*
+ * Post-order walk with an explicit stack, like llvm_emit_stmt_expr, so a
+ * `+` is folded once both of its operands are.
+ */
+static void fold_expr(FoldContext *ctx, ExprId id) {
+  const AST *ast = ctx->ast;
+  size_t base = ctx->frame_count;
+  fold_push_frame(ctx, id);
+
+  while (ctx->frame_count > base) {
+    FoldFrame *frame = &ctx->frames[ctx->frame_count - 1];
+    ExprId expr_id = frame->id;
+    const ExprNode *expr = &ast->exprs.items[expr_id];
+
+    switch (expr->type) {
+    case EXPR_IDENT:
+      fold_ident(ctx, expr_id);
+      break;
+    case EXPR_CALL: {
+      const ExprCall *call = &ast->calls.items[expr->index];
+      if (frame->step < call->argc) {
+        fold_push_frame(ctx, AST_CallArg(ast, call, frame->step++));
+        continue;
+      }
+      break;
+    }
+    case EXPR_BINOP: {
+      const ExprBinOp *binop = &ast->binops.items[expr->index];
+      if (frame->step < 2) {
+        fold_push_frame(ctx, frame->step++ ? binop->rhs : binop->lhs);
+        continue;
+      }
+      fold_binop(ctx, expr_id);
+      break;
+    }
+    }
+    ctx->frame_count--;
+  }
+}
+
+// Globals are never reassigned, a constant one is its initializer. Inside
+// functions only ints are replaced, a string stays a pointer to its global
+// instead of becoming a copy.
+static void fold_ident(FoldContext *ctx, ExprId id) {
+  AST *ast = ctx->ast;
+  const ExprIdent *ident = &ast->idents.items[ast->exprs.items[id].index];
+  FoldGlobal *global = fold_global(ctx, ident->label);
+  if (!global->name || !global->constant) {
+    return;
+  }
+  if (ctx->in_function &&
+      ast->literals.items[global->value.index].type != EXPR_LITERAL_NUM) {
+    return;
+  }
+  ast->exprs.items[id] = global->value;
+}
+
+/*
+ * Ints add as i32 and wrap, so a constant can move across the other
+ * operand: both of (x + a) + b and (a + x) + b become x + (a + b). Only
+ * constants move, so calls still run in order.
+ */
+static void fold_binop(FoldContext *ctx, ExprId id) {
+  AST *ast = ctx->ast;
+  const ExprBinOp binop = ast->binops.items[ast->exprs.items[id].index];
+  if (binop.op != BINOP_PLUS) {
+    return;
+  }
+
+  int32_t lhs, rhs;
+  if (!int_literal(ast, binop.rhs, &rhs)) {
+    return;
+  }
+  if (int_literal(ast, binop.lhs, &lhs)) {
+    int32_t sum = (int32_t)((uint32_t)lhs + (uint32_t)rhs);
+    AST_SetLiteral(ast, id, (ExprLiteral){EXPR_LITERAL_NUM, {.number = sum}});
+    return;
+  }
+
+  const ExprNode *lhs_node = &ast->exprs.items[binop.lhs];
+  if (lhs_node->type != EXPR_BINOP) {
+    return;
+  }
+  const ExprBinOp *inner = &ast->binops.items[lhs_node->index];
+  ExprId constant;
+  if (inner->op != BINOP_PLUS) {
+    return;
+  }
+  if (int_literal(ast, inner->rhs, &lhs)) {
+    constant = inner->rhs;
+  } else if (int_literal(ast, inner->lhs, &lhs)) {
+    constant = inner->lhs;
+  } else {
+    return;
+  }
+  int32_t sum = (int32_t)((uint32_t)lhs + (uint32_t)rhs);
+  AST_SetLiteral(ast, constant,
+                 (ExprLiteral){EXPR_LITERAL_NUM, {.number = sum}});
+  // the inner `+` takes this one's place
+  ast->exprs.items[id] = ast->exprs.items[binop.lhs];
+}
+
+// A literal or a global: evaluating it has no effect and can't fail. A `+`
+// left over from folding has a string or an unknown operand, codegen gets
+// to report it.
+static bool fold_is_pure(FoldContext *ctx, ExprId id) {
+  const AST *ast = ctx->ast;
+  const ExprNode *expr = &ast->exprs.items[id];
+  switch (expr->type) {
+  case EXPR_LITERAL:
+    return true;
+  case EXPR_IDENT:
+    return fold_global(ctx, ast->idents.items[expr->index].label)->name;
+  default:
+    return false;
+  }
+}
+
+static bool int_literal(const AST *ast, ExprId id, int32_t *value) {
+  const ExprNode *expr = &ast->exprs.items[id];
+  if (expr->type != EXPR_LITERAL ||
+      ast->literals.items[expr->index].type != EXPR_LITERAL_NUM) {
+    return false;
+  }
+  // truncated to the i32 codegen makes of it
+  *value = (int32_t)ast->literals.items[expr->index].value.number;
+  return true;
+}
+
+// The slot of name, empty if it isn't defined yet
+static FoldGlobal *fold_global(FoldContext *ctx, const char *name) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char *c = name; *c; ++c) {
+    hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+  }
+  size_t mask = ctx->global_capacity - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    FoldGlobal *global = &ctx->globals[i];
+    if (!global->name || strcmp(global->name, name) == 0) {
+      return global;
+    }
+  }
+}
+
+static void fold_push_frame(FoldContext *ctx, ExprId id) {
+  if (ctx->frame_count == ctx->frame_capacity) {
+    ctx->frame_capacity = ctx->frame_capacity ? ctx->frame_capacity * 2 : 16;
+    ctx->frames =
+        Mem_Realloc(ctx->frames, sizeof(FoldFrame) * ctx->frame_capacity);
+    if (!ctx->frames) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  ctx->frames[ctx->frame_count++] = (FoldFrame){.id = id};
+}
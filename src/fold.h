@@ -0,0 +1,12 @@
+#ifndef SML_FOLD
+#define SML_FOLD
+
+#include "ast.h"
+
+// Run between AST_type_check and codegen. Folds int constants, global or
+// literal, through `+` chains, gives globals initialized from other
+// globals their value, and drops expression statements that do nothing.
+// Programs behave the same, errors included.
+void AST_fold(AST *ast);
+
+#endif
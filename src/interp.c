@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "backend.h"
+#include "interp.h"
+#include "llvm_gen.h"
+
+typedef struct Promotion {
+  Interp *interp;
+  BcFunction *fn;
+} Promotion;
+
+static Value interp_run(Interp *, BcFunction *entry);
+static void interp_push_frame(Interp *, BcFunction *, uint32_t dst);
+static Value interp_call_native(const BcFunction *, void *native);
+static void interp_promote(Interp *, BcFunction *);
+static void promote_task(void *arg);
+
+int Interp_New(Interp *interp, const AST *ast, char *source_file, JIT *jit,
+               uint32_t hot_calls, int opt_level, const char *passes) {
+  memset(interp, 0, sizeof(Interp));
+  if (Bytecode_Compile(&interp->bc, ast) != 0) {
+    Bytecode_Free(&interp->bc);
+    return 1;
+  }
+  interp->globals = malloc(sizeof(Value) * (interp->bc.global_count + 1));
+  interp->ast = ast;
+  interp->source_file = source_file;
+  interp->jit = hot_calls ? jit : NULL;
+  interp->hot_calls = hot_calls;
+  interp->opt_level = opt_level;
+  interp->passes = passes;
+  if (interp->jit) {
+    interp->compiler = ThreadPool_New(1);
+    SmlCompiler_Init(&interp->codegen, JIT_Context(jit), stderr);
+  }
+  return 0;
+}
+
+int Interp_RunMain(Interp *interp, int *exit_code) {
+  int32_t main_fn = Bytecode_FindFunction(&interp->bc, "main");
+  if (main_fn < 0) {
+    fprintf(stderr, "[Error] The program has no main function\n");
+    return 1;
+  }
+
+  interp_run(interp, &interp->bc.init);
+  *exit_code = interp_run(interp, &interp->bc.fns[main_fn]).i;
+  return 0;
+}
+
+void Interp_Free(Interp *interp) {
+  if (interp->compiler) {
+    __atomic_store_n(&interp->stopping, true, __ATOMIC_RELAXED);
+    ThreadPool_Free(interp->compiler);
+    SmlCompiler_Free(&interp->codegen);
+  }
+  Bytecode_Free(&interp->bc);
+  free(interp->globals);
+  free(interp->regs);
+  free(interp->frames);
+}
+
+/*
+ * Calls between interpreted functions push a frame instead of recursing, so
+ * the machine stack only grows with native code.
+ */
+static Value interp_run(Interp *interp, BcFunction *entry) {
+  Bytecode *bc = &interp->bc;
+  size_t base_frame = interp->frame_count;
+  interp_push_frame(interp, entry, 0);
+
+  for (;;) {
+    InterpFrame *frame = &interp->frames[interp->frame_count - 1];
+    Instr *instr = &frame->fn->code[frame->pc++];
+    Value *r = interp->regs + frame->base;
+
+    switch (instr->op) {
+    case OP_INT:
+      r[instr->a].i = (int32_t)instr->b;
+      break;
+    case OP_STR:
+      r[instr->a].s = bc->strings[instr->b];
+      break;
+    case OP_GLOBAL:
+      r[instr->a] = interp->globals[instr->b];
+      break;
+    case OP_SET_GLOBAL:
+      interp->globals[instr->a] = r[instr->b];
+      break;
+    case OP_ADD:
+      // wraps like the i32 add LLVM emits
+      r[instr->a].i =
+          (int32_t)((uint32_t)r[instr->b].i + (uint32_t)r[instr->c].i);
+      break;
+    case OP_PRINT:
+      // the string is the format, as in the compiled program
+      r[instr->a].i = printf(r[instr->b].s);
+      break;
+    case OP_CALL: {
+      BcFunction *callee = &bc->fns[instr->b];
+      void *native = __atomic_load_n(&callee->native, __ATOMIC_ACQUIRE);
+      if (native) {
+        instr->op = OP_CALL_NATIVE;
+        r[instr->a] = interp_call_native(callee, native);
+        break;
+      }
+      if (interp->jit && ++callee->calls == interp->hot_calls) {
+        interp_promote(interp, callee);
+      }
+      interp_push_frame(interp, callee, instr->a);
+      break;
+    }
+    case OP_CALL_NATIVE: {
+      // only patched after the acquire load above saw the code
+      BcFunction *callee = &bc->fns[instr->b];
+      void *native = __atomic_load_n(&callee->native, __ATOMIC_RELAXED);
+      r[instr->a] = interp_call_native(callee, native);
+      break;
+    }
+    case OP_RET: {
+      Value value = r[instr->a];
+      uint32_t dst = frame->dst;
+      interp->frame_count--;
+      if (interp->frame_count == base_frame) {
+        return value;
+      }
+      InterpFrame *caller = &interp->frames[interp->frame_count - 1];
+      interp->regs[caller->base + dst] = value;
+      break;
+    }
+    }
+  }
+}
+
+static void interp_push_frame(Interp *interp, BcFunction *fn, uint32_t dst) {
+  size_t base = 0;
+  if (interp->frame_count > 0) {
+    InterpFrame *caller = &interp->frames[interp->frame_count - 1];
+    base = caller->base + caller->fn->reg_count;
+  }
+
+  if (interp->frame_count == interp->frame_capacity) {
+    interp->frame_capacity =
+        interp->frame_capacity ? interp->frame_capacity * 2 : 16;
+    interp->frames =
+        realloc(interp->frames, sizeof(InterpFrame) * interp->frame_capacity);
+    if (!interp->frames) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  if (base + fn->reg_count > interp->reg_capacity) {
+    size_t capacity = interp->reg_capacity ? interp->reg_capacity : 256;
+    while (capacity < base + fn->reg_count) {
+      capacity *= 2;
+    }
+    interp->regs = realloc(interp->regs, sizeof(Value) * capacity);
+    if (!interp->regs) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+    interp->reg_capacity = capacity;
+  }
+
+  interp->frames[interp->frame_count++] =
+      (InterpFrame){.fn = fn, .pc = 0, .base = base, .dst = dst};
+}
+
+static Value interp_call_native(const BcFunction *fn, void *native) {
+  Value value;
+  if (fn->decl->return_type == TYPE_STR) {
+    value.s = ((const char *(*)(void))native)();
+  } else {
+    value.i = ((int32_t(*)(void))native)();
+  }
+  return value;
+}
+
+static void interp_promote(Interp *interp, BcFunction *fn) {
+  if (fn->queued) {
+    return;
+  }
+  fn->queued = true;
+  Promotion *job = malloc(sizeof(Promotion));
+  if (!job) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  *job = (Promotion){.interp = interp, .fn = fn};
+  ThreadPool_Submit(interp->compiler, promote_task, job);
+}
+
+/*
+ * Runs on the compiler thread. Native code can't call back into the
+ * interpreter, so the function is compiled along with every function it
+ * reaches that isn't in the JIT yet; those already there are only declared.
+ * Code is published once the whole batch is compiled, so a caller never
+ * sees a function whose callees are missing.
+ */
+static void promote_task(void *arg) {
+  Promotion *job = arg;
+  Interp *interp = job->interp;
+  BcFunction *root = job->fn;
+  free(job);
+  if (__atomic_load_n(&interp->stopping, __ATOMIC_RELAXED) || root->jitted) {
+    return;
+  }
+
+  Bytecode *bc = &interp->bc;
+  BcFunction **batch = malloc(sizeof(BcFunction *) * bc->fn_count);
+  const StmtFnDecl **decls = malloc(sizeof(StmtFnDecl *) * bc->fn_count);
+  size_t batch_count = 0;
+  root->jitted = true;
+  batch[batch_count++] = root;
+  // batch doubles as the work list, callees are appended as they're found
+  for (size_t i = 0; i < batch_count; ++i) {
+    for (uint32_t j = 0; j < batch[i]->callee_count; ++j) {
+      BcFunction *callee = &bc->fns[batch[i]->callees[j]];
+      if (!callee->jitted) {
+        callee->jitted = true;
+        batch[batch_count++] = callee;
+      }
+    }
+  }
+  for (size_t i = 0; i < batch_count; ++i) {
+    decls[i] = batch[i]->decl;
+  }
+
+  LLVMModuleRef module =
+      llvm_emit_functions(&interp->codegen, interp->ast, interp->source_file,
+                          NULL, decls, batch_count, LLVMInternalLinkage);
+  if (module) {
+    JIT_SetTarget(interp->jit, module);
+    if (Backend_Optimize(module, NULL, interp->opt_level, interp->passes,
+                         &interp->codegen.diag) != 0) {
+      LLVMDisposeModule(module);
+      module = NULL;
+    }
+  }
+  if (module && JIT_AddModule(interp->jit, module) == 0) {
+    void *natives[batch_count];
+    size_t compiled = 0;
+    while (compiled < batch_count) {
+      LLVMOrcExecutorAddress address;
+      if (JIT_Lookup(interp->jit, decls[compiled]->name, &address) != 0) {
+        break;
+      }
+      natives[compiled++] = (void *)address;
+    }
+    for (size_t i = 0; compiled == batch_count && i < batch_count; ++i) {
+      __atomic_store_n(&batch[i]->native, natives[i], __ATOMIC_RELEASE);
+    }
+  }
+  // on failure the batch simply stays interpreted
+
+  free(batch);
+  free(decls);
+}
@@ -0,0 +1,61 @@
+#ifndef SML_INTERP
+#define SML_INTERP
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "compiler.h"
+#include "jit.h"
+#include "thread_pool.h"
+
+// Calls after which a function is promoted to the JIT by default
+#define SML_HOT_CALLS 1000
+
+typedef struct InterpFrame {
+  BcFunction *fn;
+  uint32_t pc;
+  size_t base; // of the function's registers in Interp.regs
+  uint32_t dst; // caller register receiving the result
+} InterpFrame;
+
+/*
+ * Tiered execution for `sml run --tiered`. The program starts right away in
+ * the bytecode interpreter; a function called hot_calls times is compiled by
+ * LLVM on a background thread, together with any callee not compiled yet,
+ * and its call sites are patched to the native code the next time they run.
+ */
+typedef struct Interp {
+  Bytecode bc;
+  Value *globals;
+
+  Value *regs;
+  size_t reg_capacity;
+  InterpFrame *frames;
+  size_t frame_count, frame_capacity;
+
+  // promotion, off when jit is NULL or hot_calls is 0
+  const AST *ast;
+  char *source_file;
+  JIT *jit;
+  uint32_t hot_calls;
+  int opt_level;
+  const char *passes;
+  ThreadPool *compiler; // a single thread, promotions run in order
+  SmlCompiler codegen;  // in the JIT's context, only used by that thread
+  bool stopping;
+} Interp;
+
+// Compile the program to bytecode. The AST and the JIT must outlive the
+// interpreter, which may still read them from the compiler thread.
+// Non-zero, after reporting why, if the program is invalid.
+int Interp_New(Interp *interp, const AST *ast, char *source_file, JIT *jit,
+               uint32_t hot_calls, int opt_level, const char *passes);
+// Initialize the globals and interpret `int main()`
+int Interp_RunMain(Interp *interp, int *exit_code);
+// Waits for a promotion in progress, queued ones are dropped
+void Interp_Free(Interp *interp);
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdio.h>
+
+#include <llvm-c/Core.h>
+#include <llvm-c/Error.h>
+
+#include "backend.h"
+#include "jit.h"
+
+static int report_error(const char *what, LLVMErrorRef err) {
+  char *message = LLVMGetErrorMessage(err);
+  fprintf(stderr, "[Error] %s: %s\n", what, message);
+  LLVMDisposeErrorMessage(message);
+  return 1;
+}
+
+int JIT_New(JIT *jit) {
+  Diagnostics diag = Diagnostics_New(stderr);
+  int status = Backend_InitNative(&diag);
+  Diagnostics_Free(&diag);
+  if (status != 0) {
+    return 1;
+  }
+
+  // NULL builder: host target machine, default object linking layer
+  LLVMErrorRef err = LLVMOrcCreateLLJIT(&jit->lljit, NULL);
+  if (err) {
+    return report_error("Unable to create JIT", err);
+  }
+
+  LLVMOrcDefinitionGeneratorRef process_symbols;
+  err = LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(
+      &process_symbols, LLVMOrcLLJITGetGlobalPrefix(jit->lljit), NULL, NULL);
+  if (err) {
+    LLVMOrcDisposeLLJIT(jit->lljit);
+    return report_error("Unable to search the process for symbols", err);
+  }
+  LLVMOrcJITDylibAddGenerator(LLVMOrcLLJITGetMainJITDylib(jit->lljit),
+                              process_symbols);
+
+  jit->context = LLVMOrcCreateNewThreadSafeContext();
+  return 0;
+}
+
+LLVMContextRef JIT_Context(JIT *jit) {
+  return LLVMOrcThreadSafeContextGetContext(jit->context);
+}
+
+void JIT_SetTarget(JIT *jit, LLVMModuleRef module) {
+  LLVMSetTarget(module, LLVMOrcLLJITGetTripleString(jit->lljit));
+  LLVMSetDataLayout(module, LLVMOrcLLJITGetDataLayoutStr(jit->lljit));
+}
+
+int JIT_AddModule(JIT *jit, LLVMModuleRef module) {
+  LLVMOrcThreadSafeModuleRef tsm =
+      LLVMOrcCreateNewThreadSafeModule(module, jit->context);
+  LLVMErrorRef err = LLVMOrcLLJITAddLLVMIRModule(
+      jit->lljit, LLVMOrcLLJITGetMainJITDylib(jit->lljit), tsm);
+  if (err) {
+    LLVMOrcDisposeThreadSafeModule(tsm);
+    return report_error("Unable to add module to the JIT", err);
+  }
+  return 0;
+}
+
+int JIT_Lookup(JIT *jit, const char *name, LLVMOrcExecutorAddress *address) {
+  LLVMErrorRef err = LLVMOrcLLJITLookup(jit->lljit, address, name);
+  if (err) {
+    char *message = LLVMGetErrorMessage(err);
+    fprintf(stderr, "[Error] Unable to compile %s: %s\n", name, message);
+    LLVMDisposeErrorMessage(message);
+    return 1;
+  }
+  return 0;
+}
+
+int JIT_RunMain(JIT *jit, LLVMModuleRef module, int *exit_code) {
+  if (JIT_AddModule(jit, module) != 0) {
+    return 1;
+  }
+
+  // materializes main and everything it references
+  LLVMOrcExecutorAddress main_addr;
+  if (JIT_Lookup(jit, "main", &main_addr) != 0) {
+    return 1;
+  }
+
+  int (*main_fn)(void) = (int (*)(void))main_addr;
+  *exit_code = main_fn();
+  return 0;
+}
+
+void JIT_Free(JIT *jit) {
+  LLVMOrcDisposeLLJIT(jit->lljit);
+  LLVMOrcDisposeThreadSafeContext(jit->context);
+}
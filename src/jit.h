@@ -0,0 +1,29 @@
+#ifndef SML_JIT
+#define SML_JIT
+
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Orc.h>
+#include <llvm-c/Types.h>
+
+// In-memory execution for `sml run`: an ORC LLJIT for the host, with
+// undefined symbols (printf and the other StdLib builtins) resolved against
+// the running process.
+typedef struct JIT {
+  LLVMOrcLLJITRef lljit;
+  LLVMOrcThreadSafeContextRef context;
+} JIT;
+
+int JIT_New(JIT *jit);
+// Modules handed to the JIT must be created in this context
+LLVMContextRef JIT_Context(JIT *jit);
+// Give the module the JIT's triple and data layout, before optimizing it
+void JIT_SetTarget(JIT *jit, LLVMModuleRef module);
+// Takes ownership of the module; its code is compiled on first lookup
+int JIT_AddModule(JIT *jit, LLVMModuleRef module);
+// Address of a symbol of an added module, compiling it if need be
+int JIT_Lookup(JIT *jit, const char *name, LLVMOrcExecutorAddress *address);
+// Takes ownership of the module, compiles it and calls its `int main()`
+int JIT_RunMain(JIT *jit, LLVMModuleRef module, int *exit_code);
+void JIT_Free(JIT *jit);
+
+#endif
@@ -1,172 +1,301 @@
-#include <ctype.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "lexer.h"
+#include "lexer_scan.h"
+#include "mem.h"
 #include "token.h"
 
-typedef bool (*LexerPredicate)(char);
+/*
+ * The lexer is a small DFA. Each input byte is mapped to a character class
+ * through a 256-entry table, and (state, class) selects the next action from
+ * a transition table. Actions are labels reached through a computed goto, so
+ * moving from one action to the next is a single indirect jump and there is
+ * no per-character call. Runs (whitespace, identifiers, digits, strings) are
+ * consumed by the scan kernels in one step.
+ *
+ * All tables are generated from SML_TOKEN_SYMBOLS / SML_TOKEN_KEYWORDS.
+ */
 
-static inline void read_char(Lexer *);
-static inline void skip_whitespace(Lexer *);
-static inline bool is_next_char(Lexer *, char);
-static inline char *read_while(Lexer *, LexerPredicate);
+typedef enum {
+  CLASS_OTHER = 0,
+  CLASS_EOF,
+  CLASS_SPACE,
+  CLASS_ALPHA,
+  CLASS_DIGIT,
+  CLASS_QUOTE,
+  CLASS_SYMBOL,
+  CLASS_MINUS,
+  CLASS_GT,
+  CLASS_COUNT,
+} CharClass;
 
-// predicates
-static inline bool endof_string_predicate(char x) { return x != '"'; }
-static inline bool ident_predicate(char x) { return isalnum(x) || x == '_'; }
-static inline bool number_predicate(char x) { return isdigit(x); }
+typedef enum {
+  STATE_START = 0,
+  STATE_MINUS, // seen '-', waiting for '>'
+  STATE_COUNT,
+} LexState;
 
-Token Lexer_NextToken(Lexer *l) {
-  skip_whitespace(l);
+typedef enum {
+  ACTION_ILLEGAL = 0,
+  ACTION_EOF,
+  ACTION_SKIP_SPACE,
+  ACTION_IDENT,
+  ACTION_NUMBER,
+  ACTION_STRING,
+  ACTION_SYMBOL,
+  ACTION_MINUS,
+  ACTION_ARROW,
+  ACTION_LONE_MINUS,
+  ACTION_COUNT,
+} LexAction;
 
-  Token token;
-  token.position.line = l->line;
-  token.position.colm = l->colm;
+static const unsigned char char_class[256] = {
+    [0] = CLASS_EOF,
+    [' '] = CLASS_SPACE,
+    ['\t' ... '\r'] = CLASS_SPACE,
+    ['a' ... 'z'] = CLASS_ALPHA,
+    ['A' ... 'Z'] = CLASS_ALPHA,
+    ['_'] = CLASS_ALPHA,
+    ['0' ... '9'] = CLASS_DIGIT,
+    ['"'] = CLASS_QUOTE,
+    ['-'] = CLASS_MINUS,
+    ['>'] = CLASS_GT,
+#define X(type, ch) [(unsigned char)(ch)] = CLASS_SYMBOL,
+    SML_TOKEN_SYMBOLS(X)
+#undef X
+};
 
-  if (l->curr_char == 0) {
-    token.type = TOKEN_EOF;
-    return token;
-  }
+static const unsigned char symbol_token[256] = {
+#define X(type, ch) [(unsigned char)(ch)] = type,
+    SML_TOKEN_SYMBOLS(X)
+#undef X
+};
 
-  switch (l->curr_char) {
-  case '(':
-    read_char(l);
-    token.type = TOKEN_LPAREN;
-    return token;
-  case ')':
-    read_char(l);
-    token.type = TOKEN_RPAREN;
-    return token;
-  case '{':
-    read_char(l);
-    token.type = TOKEN_LBRACE;
-    return token;
-  case '}':
-    read_char(l);
-    token.type = TOKEN_RBRACE;
-    return token;
-  case ';':
-    read_char(l);
-    token.type = TOKEN_SEMICOLON;
-    return token;
-  case '+':
-    read_char(l);
-    token.type = TOKEN_PLUS;
-    return token;
-  case '=':
-    read_char(l);
-    token.type = TOKEN_EQUAL;
-    return token;
-  case '-':
-    if (is_next_char(l, '>')) {
-      read_char(l); // eat '-'
-      read_char(l); // eat '>'
-      token.type = TOKEN_ARROW;
-      return token;
-    }
+static const unsigned char transitions[STATE_COUNT][CLASS_COUNT] = {
+    [STATE_START] =
+        {
+            [CLASS_OTHER] = ACTION_ILLEGAL,
+            [CLASS_EOF] = ACTION_EOF,
+            [CLASS_SPACE] = ACTION_SKIP_SPACE,
+            [CLASS_ALPHA] = ACTION_IDENT,
+            [CLASS_DIGIT] = ACTION_NUMBER,
+            [CLASS_QUOTE] = ACTION_STRING,
+            [CLASS_SYMBOL] = ACTION_SYMBOL,
+            [CLASS_MINUS] = ACTION_MINUS,
+            [CLASS_GT] = ACTION_ILLEGAL,
+        },
+    [STATE_MINUS] =
+        {
+            [CLASS_OTHER] = ACTION_LONE_MINUS,
+            [CLASS_EOF] = ACTION_LONE_MINUS,
+            [CLASS_SPACE] = ACTION_LONE_MINUS,
+            [CLASS_ALPHA] = ACTION_LONE_MINUS,
+            [CLASS_DIGIT] = ACTION_LONE_MINUS,
+            [CLASS_QUOTE] = ACTION_LONE_MINUS,
+            [CLASS_SYMBOL] = ACTION_LONE_MINUS,
+            [CLASS_MINUS] = ACTION_LONE_MINUS,
+            [CLASS_GT] = ACTION_ARROW,
+        },
+};
+
+// Perfect hash over (length, first char) of the keyword set: every keyword
+// owns a distinct slot, so a lookup is one hash, a length check and a memcmp.
+#define KEYWORD_SLOTS 8
+#define KEYWORD_SLOT(len, first) (((len) + (unsigned char)(first)) & 7)
+
+static const struct {
+  const char *text;
+  size_t len;
+  TokenType type;
+} keywords[KEYWORD_SLOTS] = {
+#define X(type_, text_, first)                                                 \
+  [KEYWORD_SLOT(sizeof(text_) - 1, first)] = {text_, sizeof(text_) - 1, type_},
+    SML_TOKEN_KEYWORDS(X)
+#undef X
+};
+
+// Never called, fails to compile ("duplicate case value") when two keywords
+// hash to the same slot
+static inline void keyword_slots_are_unique(size_t slot) {
+  switch (slot) {
+#define X(type, text, first) case KEYWORD_SLOT(sizeof(text) - 1, first):
+    SML_TOKEN_KEYWORDS(X)
+#undef X
     break;
-  case '"':
-    read_char(l);
-    token.type = TOKEN_STRING;
-    token.value.string = read_while(l, endof_string_predicate);
-    read_char(l);
-    return token;
   }
+}
 
-  if (isalpha(l->curr_char) || l->curr_char == '_') {
-    char *label = read_while(l, ident_predicate);
-    bool can_free_label = true;
-
-    if (strcmp(label, "function") == 0) {
-      token.type = TOKEN_FN_DECL;
-    } else if (strcmp(label, "int") == 0) {
-      token.type = TOKEN_TYPE_INT;
-    } else if (strcmp(label, "return") == 0) {
-      token.type = TOKEN_RETURN;
-    } else if (strcmp(label, "let") == 0) {
-      token.type = TOKEN_LET;
-    } else {
-      token.type = TOKEN_IDENT;
-      token.value.string = label;
-      can_free_label = false;
-    }
+static inline TokenType lookup_keyword(const char *, size_t);
+static inline long long span_to_number(const char *, TokenSpan);
 
-    if (can_free_label) {
-      free(label);
-    }
+static inline CharClass class_at(const char *buffer, size_t pos, size_t len) {
+  return pos < len ? char_class[(unsigned char)buffer[pos]] : CLASS_EOF;
+}
 
-    return token;
-  }
+Token Lexer_NextToken(Lexer *l) {
+  static void *const actions[ACTION_COUNT] = {
+      [ACTION_ILLEGAL] = &&illegal,       [ACTION_EOF] = &&eof,
+      [ACTION_SKIP_SPACE] = &&skip_space, [ACTION_IDENT] = &&ident,
+      [ACTION_NUMBER] = &&number,         [ACTION_STRING] = &&string,
+      [ACTION_SYMBOL] = &&symbol,         [ACTION_MINUS] = &&minus,
+      [ACTION_ARROW] = &&arrow,           [ACTION_LONE_MINUS] = &&lone_minus,
+  };
+
+  const char *buffer = l->buffer;
+  size_t len = l->buffer_len;
+  size_t pos = l->pos;
+  LexState state = STATE_START;
+  Token token;
+
+#define DISPATCH() goto *actions[transitions[state][class_at(buffer, pos, len)]]
+
+  DISPATCH();
+
+skip_space:
+  pos = l->scan->skip_whitespace(buffer, pos, len);
+  DISPATCH();
 
-  if (isdigit(l->curr_char)) {
-    char *label = read_while(l, number_predicate);
-    token.type = TOKEN_NUMBER;
-    token.value.number = strtoll(label, NULL, 10);
-    free(label);
-    return token;
+eof:
+  // a null byte ends the input too, stay on it
+  token.type = TOKEN_EOF;
+  token.span.start = pos;
+  token.span.len = 0;
+  goto done;
+
+ident:
+  token.span.start = pos;
+  pos = l->scan->scan_ident(buffer, pos, len);
+  token.span.len = pos - token.span.start;
+  token.type = lookup_keyword(buffer + token.span.start, token.span.len);
+  goto done;
+
+number:
+  token.span.start = pos;
+  pos = l->scan->scan_digits(buffer, pos, len);
+  token.span.len = pos - token.span.start;
+  token.type = TOKEN_NUMBER;
+  token.value.number = span_to_number(buffer, token.span);
+  goto done;
+
+string:
+  // the span excludes the quotes; an unterminated string runs to the end
+  token.span.start = pos + 1;
+  pos = l->scan->scan_string(buffer, pos + 1, len);
+  token.span.len = pos - token.span.start;
+  token.type = TOKEN_STRING;
+  if (pos < len) {
+    pos++;
   }
+  goto done;
+
+symbol:
+  token.type = symbol_token[(unsigned char)buffer[pos]];
+  token.span.start = pos++;
+  token.span.len = 1;
+  goto done;
+
+minus:
+  token.span.start = pos++;
+  state = STATE_MINUS;
+  DISPATCH();
 
+arrow:
+  pos++;
+  token.span.len = 2;
+  token.type = TOKEN_ARROW;
+  goto done;
+
+lone_minus:
+  token.span.len = 1;
+  token.type = TOKEN_ILLEGAL;
+  token.value.char_ = '-';
+  goto done;
+
+illegal:
   token.type = TOKEN_ILLEGAL;
-  token.value.char_ = l->curr_char;
-  read_char(l);
+  token.value.char_ = buffer[pos];
+  token.span.start = pos++;
+  token.span.len = 1;
+  goto done;
+
+#undef DISPATCH
+
+done:
+  l->pos = pos;
   return token;
 }
 
-Lexer Lexer_New(char *buffer) {
+Lexer Lexer_New(const char *buffer, size_t buffer_len) {
   Lexer l;
   l.buffer = buffer;
-  l.buffer_len = strlen(buffer);
-  l.line = 1;
-  l.colm = 0;
+  l.buffer_len = buffer_len;
   l.pos = 0;
-  l.read_pos = 0;
-  l.curr_char = 0;
-  read_char(&l);
+  l.scan = LexerScan_Kernels();
+  l.newlines = NULL;
+  l.newline_count = 0;
   return l;
 }
 
-void skip_whitespace(Lexer *l) {
-  while (l->curr_char != 0 && isspace(l->curr_char)) {
-    read_char(l);
+TokenPosition Lexer_Position(Lexer *l, size_t offset) {
+  if (!l->newlines) {
+    size_t capacity = 64;
+    l->newlines = Mem_Alloc(sizeof(size_t) * capacity);
+    const char *at = l->buffer;
+    const char *end = l->buffer + l->buffer_len;
+    while ((at = memchr(at, '\n', end - at))) {
+      if (l->newline_count == capacity) {
+        capacity *= 2;
+        l->newlines = Mem_Realloc(l->newlines, sizeof(size_t) * capacity);
+      }
+      l->newlines[l->newline_count++] = at - l->buffer;
+      at++;
+    }
   }
-}
 
-void read_char(Lexer *l) {
-  l->pos = l->read_pos;
-
-  if (l->read_pos >= l->buffer_len) {
-    l->curr_char = 0;
-    return;
+  // number of newlines before offset
+  size_t lo = 0, hi = l->newline_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (l->newlines[mid] < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
   }
 
-  l->curr_char = l->buffer[l->read_pos];
-  l->read_pos += 1;
+  TokenPosition position;
+  position.line = lo + 1;
+  position.colm = lo ? offset - l->newlines[lo - 1] : offset + 1;
+  return position;
+}
 
-  if (l->curr_char == '\n') {
-    l->line += 1;
-    l->colm = 0;
-  } else {
-    l->colm += 1;
-  }
+void Lexer_Free(Lexer *l) {
+  Mem_Free(l->newlines);
+  l->newlines = NULL;
+  l->newline_count = 0;
 }
 
-bool is_next_char(Lexer *l, char x) {
-  if (l->read_pos >= l->buffer_len) {
-    return false;
+TokenType lookup_keyword(const char *text, size_t len) {
+  size_t slot = KEYWORD_SLOT(len, text[0]);
+  if (keywords[slot].len == len &&
+      memcmp(keywords[slot].text, text, len) == 0) {
+    return keywords[slot].type;
   }
-  return l->buffer[l->read_pos] == x;
+  return TOKEN_IDENT;
 }
 
-char *read_while(Lexer *l, LexerPredicate pred) {
-  size_t start = l->pos;
-  while (l->curr_char != 0 && pred(l->curr_char)) {
-    read_char(l);
+// Same result as strtoll on a run of digits, including saturation
+long long span_to_number(const char *buffer, TokenSpan span) {
+  unsigned long long value = 0;
+  for (size_t i = 0; i < span.len; ++i) {
+    unsigned digit = buffer[span.start + i] - '0';
+    if (value > ((unsigned long long)LLONG_MAX - digit) / 10) {
+      return LLONG_MAX;
+    }
+    value = value * 10 + digit;
   }
-  size_t len = l->pos - start;
-  char *substr = (char *)malloc(sizeof(char) * (len + 1));
-  strncpy(substr, l->buffer + start, len);
-  substr[len] = 0;
-  return substr;
+  return (long long)value;
 }
@@ -1,23 +1,27 @@
 #ifndef SML_LEXER
 #define SML_LEXER
 
+#include "lexer_scan.h"
 #include "token.h"
 #include <stddef.h>
 #include <stdio.h>
 
 typedef struct {
-  char *buffer;
+  const char *buffer;
   size_t buffer_len;
-  char curr_char;
+  size_t pos;
 
-  size_t line;
-  size_t colm;
+  const LexerScanKernels *scan;
 
-  size_t pos;
-  size_t read_pos;
+  // Offsets of every '\n' in buffer. Line/column are only needed for
+  // diagnostics, so the index is built on the first Lexer_Position call.
+  size_t *newlines;
+  size_t newline_count;
 } Lexer;
 
-Lexer Lexer_New(char *buffer);
+Lexer Lexer_New(const char *buffer, size_t buffer_len);
 Token Lexer_NextToken(Lexer *);
+TokenPosition Lexer_Position(Lexer *, size_t offset);
+void Lexer_Free(Lexer *);
 
 #endif
@@ -0,0 +1,188 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lexer_scan.h"
+
+// Every kernel also stops at a null byte, the lexer treats it as end of input
+
+static inline bool is_space(unsigned char x) {
+  return x == ' ' || (unsigned char)(x - '\t') <= '\r' - '\t';
+}
+static inline bool is_digit(unsigned char x) {
+  return (unsigned char)(x - '0') <= 9;
+}
+static inline bool is_ident(unsigned char x) {
+  return is_digit(x) || (unsigned char)((x | 0x20) - 'a') <= 'z' - 'a' ||
+         x == '_';
+}
+
+/*  Scalar  */
+
+static size_t scalar_skip_whitespace(const char *buf, size_t pos, size_t len) {
+  while (pos < len && is_space(buf[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+static size_t scalar_scan_ident(const char *buf, size_t pos, size_t len) {
+  while (pos < len && is_ident(buf[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+static size_t scalar_scan_digits(const char *buf, size_t pos, size_t len) {
+  while (pos < len && is_digit(buf[pos])) {
+    pos++;
+  }
+  return pos;
+}
+
+static size_t scalar_scan_string(const char *buf, size_t pos, size_t len) {
+  while (pos < len && buf[pos] != '"' && buf[pos] != 0) {
+    pos++;
+  }
+  return pos;
+}
+
+const LexerScanKernels lexer_scan_scalar = {
+    .name = "scalar",
+    .skip_whitespace = scalar_skip_whitespace,
+    .scan_ident = scalar_scan_ident,
+    .scan_digits = scalar_scan_digits,
+    .scan_string = scalar_scan_string,
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/*  SSE2 (16 bytes per step)  */
+
+// Bytes of x in the unsigned range [lo, lo + span]
+static inline __m128i sse2_in_range(__m128i x, char lo, char span) {
+  __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(span)), shifted);
+}
+
+static inline __m128i sse2_space(__m128i x) {
+  return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                      sse2_in_range(x, '\t', '\r' - '\t'));
+}
+static inline __m128i sse2_digit(__m128i x) {
+  return sse2_in_range(x, '0', 9);
+}
+static inline __m128i sse2_ident(__m128i x) {
+  __m128i alpha = sse2_in_range(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a',
+                                'z' - 'a');
+  return _mm_or_si128(_mm_or_si128(alpha, sse2_digit(x)),
+                      _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+static inline __m128i sse2_string(__m128i x) {
+  __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')),
+                              _mm_cmpeq_epi8(x, _mm_setzero_si128()));
+  return _mm_xor_si128(stop, _mm_set1_epi8(-1));
+}
+
+// `matches` yields 0xff for every byte that continues the run
+#define SSE2_SCAN(name, matches, scalar)                                       \
+  static size_t name(const char *buf, size_t pos, size_t len) {               \
+    while (pos + 16 <= len) {                                                  \
+      __m128i x = _mm_loadu_si128((const __m128i *)(buf + pos));              \
+      unsigned stop = ~(unsigned)_mm_movemask_epi8(matches(x)) & 0xffff;      \
+      if (stop) {                                                              \
+        return pos + __builtin_ctz(stop);                                      \
+      }                                                                        \
+      pos += 16;                                                               \
+    }                                                                          \
+    return scalar(buf, pos, len);                                              \
+  }
+
+SSE2_SCAN(sse2_skip_whitespace, sse2_space, scalar_skip_whitespace)
+SSE2_SCAN(sse2_scan_ident, sse2_ident, scalar_scan_ident)
+SSE2_SCAN(sse2_scan_digits, sse2_digit, scalar_scan_digits)
+SSE2_SCAN(sse2_scan_string, sse2_string, scalar_scan_string)
+
+const LexerScanKernels lexer_scan_sse2 = {
+    .name = "sse2",
+    .skip_whitespace = sse2_skip_whitespace,
+    .scan_ident = sse2_scan_ident,
+    .scan_digits = sse2_scan_digits,
+    .scan_string = sse2_scan_string,
+};
+
+/*  AVX2 (32 bytes per step)  */
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i avx2_in_range(__m256i x, char lo, char span) {
+  __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(span)),
+                           shifted);
+}
+
+static inline AVX2 __m256i avx2_space(__m256i x) {
+  return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                         avx2_in_range(x, '\t', '\r' - '\t'));
+}
+static inline AVX2 __m256i avx2_digit(__m256i x) {
+  return avx2_in_range(x, '0', 9);
+}
+static inline AVX2 __m256i avx2_ident(__m256i x) {
+  __m256i alpha = avx2_in_range(_mm256_or_si256(x, _mm256_set1_epi8(0x20)),
+                                'a', 'z' - 'a');
+  return _mm256_or_si256(_mm256_or_si256(alpha, avx2_digit(x)),
+                         _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+static inline AVX2 __m256i avx2_string(__m256i x) {
+  __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')),
+                                 _mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+  return _mm256_xor_si256(stop, _mm256_set1_epi8(-1));
+}
+
+// The upper halves are cleared on the way out: GCC only does it by itself
+// at -O2 and up, and legacy SSE code run with them dirty (the lexer, the
+// SSE2 tail, libc) pays a state transition on every instruction
+#define AVX2_SCAN(name, matches, tail)                                         \
+  static AVX2 size_t name(const char *buf, size_t pos, size_t len) {          \
+    while (pos + 32 <= len) {                                                  \
+      __m256i x = _mm256_loadu_si256((const __m256i *)(buf + pos));           \
+      uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(matches(x));            \
+      if (stop) {                                                              \
+        _mm256_zeroupper();                                                    \
+        return pos + __builtin_ctz(stop);                                      \
+      }                                                                        \
+      pos += 32;                                                               \
+    }                                                                          \
+    _mm256_zeroupper();                                                        \
+    return tail(buf, pos, len);                                                \
+  }
+
+AVX2_SCAN(avx2_skip_whitespace, avx2_space, sse2_skip_whitespace)
+AVX2_SCAN(avx2_scan_ident, avx2_ident, sse2_scan_ident)
+AVX2_SCAN(avx2_scan_digits, avx2_digit, sse2_scan_digits)
+AVX2_SCAN(avx2_scan_string, avx2_string, sse2_scan_string)
+
+const LexerScanKernels lexer_scan_avx2 = {
+    .name = "avx2",
+    .skip_whitespace = avx2_skip_whitespace,
+    .scan_ident = avx2_scan_ident,
+    .scan_digits = avx2_scan_digits,
+    .scan_string = avx2_scan_string,
+};
+
+const LexerScanKernels *LexerScan_Kernels(void) {
+  static const LexerScanKernels *selected;
+  const LexerScanKernels *kernels =
+      __atomic_load_n(&selected, __ATOMIC_RELAXED);
+  if (!kernels) {
+    __builtin_cpu_init();
+    kernels = __builtin_cpu_supports("avx2") ? &lexer_scan_avx2
+                                             : &lexer_scan_sse2;
+    __atomic_store_n(&selected, kernels, __ATOMIC_RELAXED);
+  }
+  return kernels;
+}
+#else
+const LexerScanKernels *LexerScan_Kernels(void) { return &lexer_scan_scalar; }
+#endif
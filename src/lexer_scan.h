@@ -0,0 +1,27 @@
+#ifndef SML_LEXER_SCAN
+#define SML_LEXER_SCAN
+
+#include <stddef.h>
+
+// A scan kernel returns the offset of the first byte at or after pos that
+// ends the run it is looking for, or len when the run reaches the end.
+typedef size_t (*LexerScanFn)(const char *buffer, size_t pos, size_t len);
+
+typedef struct {
+  const char *name;
+  LexerScanFn skip_whitespace; // isspace()
+  LexerScanFn scan_ident;      // isalnum() or '_'
+  LexerScanFn scan_digits;     // isdigit()
+  LexerScanFn scan_string;     // anything but '"'
+} LexerScanKernels;
+
+extern const LexerScanKernels lexer_scan_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+extern const LexerScanKernels lexer_scan_sse2;
+extern const LexerScanKernels lexer_scan_avx2;
+#endif
+
+// Widest kernel set supported by the running CPU, picked once
+const LexerScanKernels *LexerScan_Kernels(void);
+
+#endif
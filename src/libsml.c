@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "backend.h"
+#include "compiler.h"
+#include "libsml.h"
+
+int Sml_Compile(const char *buffer, size_t len, const SmlOptions *options,
+                SmlOutput *output) {
+  SmlOptions defaults = {.emit = EMIT_LL};
+  if (!options) {
+    options = &defaults;
+  }
+  memset(output, 0, sizeof(SmlOutput));
+
+  SmlCompiler compiler;
+  SmlCompiler_Init(&compiler, NULL, NULL);
+  LLVMTargetMachineRef machine =
+      Backend_NewTargetMachine(options->opt_level, options->cpu,
+                               options->features, &compiler.diag);
+  if (!machine) {
+    output->diagnostics = compiler.diag.text;
+    compiler.diag.text = NULL;
+    SmlCompiler_Free(&compiler);
+    return 1;
+  }
+
+  char *name = (char *)(options->name ? options->name : "main.sa");
+  LLVMModuleRef module =
+      SmlCompiler_CompileModule(&compiler, buffer, len, name, machine);
+  int status = 1;
+  if (module) {
+    Backend_SetTarget(module, machine);
+    if (Backend_Optimize(module, machine, options->opt_level,
+                         options->passes, &compiler.diag) == 0 &&
+        Backend_EmitToMemory(module, machine,
+                             options->emit ? options->emit : EMIT_LL,
+                             &output->bytes, &output->len,
+                             &compiler.diag) == 0) {
+      status = 0;
+    }
+    LLVMDisposeModule(module);
+  }
+
+  // the diagnostics buffer is handed over as is
+  output->diagnostics = compiler.diag.text;
+  compiler.diag.text = NULL;
+  SmlCompiler_Free(&compiler);
+  LLVMDisposeTargetMachine(machine);
+  return status;
+}
+
+void Sml_FreeOutput(SmlOutput *output) {
+  free(output->bytes);
+  free(output->diagnostics);
+  memset(output, 0, sizeof(SmlOutput));
+}
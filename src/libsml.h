@@ -0,0 +1,35 @@
+#ifndef SML_LIBSML
+#define SML_LIBSML
+
+#include <stddef.h>
+
+#include "backend.h"
+
+/*
+ * Embedding API, built as libsml. Each call compiles with its own compiler
+ * and LLVM context, so calls are independent and may run concurrently.
+ */
+
+typedef struct SmlOptions {
+  EmitKind emit;        // 0 means EMIT_LL
+  int opt_level;        // 0 .. SML_OPT_LEVEL_MAX
+  const char *passes;   // pipeline in `opt -passes=` syntax, may be NULL
+  const char *cpu;      // as for -mcpu, NULL is generic
+  const char *features; // as for -mattr, may be NULL
+  const char *name;     // source file name recorded in the module, may be NULL
+} SmlOptions;
+
+typedef struct SmlOutput {
+  char *bytes; // the module in the requested form, NULL on error
+  size_t len;
+  char *diagnostics; // NUL-terminated, one "[Error] ..." per line, or NULL
+} SmlOutput;
+
+// Compile buffer, which need not be NUL-terminated. options may be NULL for
+// the defaults. Non-zero if the program is invalid or can't be emitted; the
+// output must be released with Sml_FreeOutput either way.
+int Sml_Compile(const char *buffer, size_t len, const SmlOptions *options,
+                SmlOutput *output);
+void Sml_FreeOutput(SmlOutput *output);
+
+#endif
@@ -1,4 +1,5 @@
-#include <assert.h>
+#include <setjmp.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,196 +8,556 @@
 #include <llvm-c/Types.h>
 
 #include "ast.h"
+#include "compiler.h"
 #include "llvm_gen.h"
+#include "mem.h"
 #include "stdlib.h"
+#include "timing.h"
 #include "type.h"
 #include "utils.h"
 
-StdLib *stdlib;
-LLVMModuleRef llvm_module;
-LLVMBuilderRef llvm_builder;
-LLVMContextRef llvm_context;
-
-LLVMTypeRef sml_to_llvm_type(Type);
-void llvm_emit_stmt_block(StmtBlock);
-void llvm_emit_stmt_function(StmtFnDecl);
-void llvm_emit_stmt_vardecl(StmtVarDecl);
-LLVMValueRef llvm_emit_stmt_expr(StmtExpr);
-LLVMValueRef llvm_emit_expr_call(ExprCall);
-LLVMValueRef llvm_emit_expr_binop(ExprBinOp);
-LLVMValueRef llvm_emit_expr_literal(ExprLiteral);
-LLVMValueRef llvm_emit_expr_ident(ExprIdent);
-
-LLVMModuleRef llvm_emit_module(AST ast, char *source_file) {
-  init_std_lib(&stdlib);
-  llvm_module = LLVMModuleCreateWithName("hello");
-  llvm_context = LLVMContextCreate();
-  llvm_builder = LLVMCreateBuilderInContext(llvm_context);
-  LLVMSetSourceFileName(llvm_module, source_file, strlen(source_file));
-
-  llvm_emit_stmt_block(ast);
-
-  LLVMDisposeBuilder(llvm_builder);
-  return llvm_module;
-}
-
-void llvm_emit_stmt_block(StmtBlock block) {
-  for (size_t i = 0; i < block.stmt_count; ++i) {
-    Stmt stmt = block.stmts[i];
-    switch (stmt.type) {
-    case STMT_FN_DECL:
-      llvm_emit_stmt_function(stmt.value.fn_decl);
+// Expression codegen work stack; step counts the children already emitted,
+// whose values wait on emit_values until their parent consumes them
+typedef struct EmitFrame {
+  ExprId id;
+  uint32_t step;
+} EmitFrame;
+
+// A string literal of the module, text is the constant's own data
+typedef struct EmitString {
+  const char *text; // NULL for an empty slot
+  size_t len;
+  LLVMValueRef ptr;
+} EmitString;
+
+LLVMTypeRef sml_to_llvm_type(SmlCompiler *, Type);
+void llvm_declare_functions(SmlCompiler *, StmtBlock);
+void llvm_emit_stmt_block(SmlCompiler *, StmtBlock);
+void llvm_emit_stmt_function(SmlCompiler *, const StmtFnDecl *);
+void llvm_emit_stmt_vardecl(SmlCompiler *, const StmtVarDecl *);
+LLVMValueRef llvm_emit_stmt_expr(SmlCompiler *, ExprId);
+LLVMValueRef llvm_emit_expr_call(SmlCompiler *, const ExprCall *,
+                                 LLVMValueRef *);
+LLVMValueRef llvm_emit_expr_binop(SmlCompiler *, const ExprBinOp *,
+                                  LLVMValueRef, LLVMValueRef);
+LLVMValueRef llvm_emit_expr_literal(SmlCompiler *, const ExprLiteral *);
+LLVMValueRef llvm_emit_expr_ident(SmlCompiler *, const ExprIdent *);
+LLVMValueRef llvm_emit_expr_user_call(SmlCompiler *, const ExprCall *);
+static LLVMValueRef llvm_builtin_decl(SmlCompiler *, const BuiltinFn *,
+                                      LLVMTypeRef *type);
+static LLVMValueRef llvm_string_ptr(SmlCompiler *, LLVMValueRef constant);
+static EmitString *string_slot(SmlCompiler *, const char *text, size_t len);
+static void llvm_reset_module_caches(SmlCompiler *);
+static void emit_push_frame(SmlCompiler *, ExprId);
+static void emit_push_value(SmlCompiler *, LLVMValueRef);
+static LLVMAttributeRef string_attribute(SmlCompiler *, const char *kind,
+                                         char *value);
+static bool llvm_defines(SmlCompiler *, const StmtFnDecl *);
+static void llvm_bail(SmlCompiler *);
+static size_t llvm_instruction_count(LLVMModuleRef);
+
+/*
+ * Errors are reported to c->diag and unwind straight back here with
+ * longjmp, whatever the depth of the walk; nothing between owns memory
+ * except the module and builder released below.
+ */
+LLVMModuleRef llvm_emit_module(SmlCompiler *c, const AST *ast,
+                               char *source_file,
+                               LLVMTargetMachineRef machine) {
+  TimingScope timing = Timing_Begin("codegen", NULL);
+  llvm_reset_module_caches(c);
+  c->ast = ast;
+  c->module = LLVMModuleCreateWithNameInContext("hello", c->context);
+  c->builder = LLVMCreateBuilderInContext(c->context);
+  LLVMSetSourceFileName(c->module, source_file, strlen(source_file));
+
+  c->target_cpu = NULL;
+  c->target_features = NULL;
+  if (machine) {
+    c->target_cpu =
+        string_attribute(c, "target-cpu", LLVMGetTargetMachineCPU(machine));
+    c->target_features = string_attribute(
+        c, "target-features", LLVMGetTargetMachineFeatureString(machine));
+  }
+
+  jmp_buf bail;
+  c->bail = &bail;
+  if (setjmp(bail) == 0) {
+    llvm_declare_functions(c, ast->root);
+    llvm_emit_stmt_block(c, ast->root);
+  } else {
+    LLVMDisposeModule(c->module);
+    c->module = NULL;
+  }
+  if (timing_enabled && c->module) {
+    Timing_Count(TIMING_IR_INSTRUCTIONS, llvm_instruction_count(c->module));
+  }
+  Timing_Unwind(timing);
+
+  c->bail = NULL;
+  c->emit_frame_count = c->emit_value_count = 0;
+  LLVMDisposeBuilder(c->builder);
+  c->builder = NULL;
+  return c->module;
+}
+
+LLVMModuleRef llvm_emit_functions(SmlCompiler *c, const AST *ast,
+                                  char *source_file,
+                                  LLVMTargetMachineRef machine,
+                                  const StmtFnDecl *const *fns,
+                                  size_t fn_count, LLVMLinkage globals) {
+  c->defined_fns = fns;
+  c->defined_fn_count = fn_count;
+  c->global_linkage = globals;
+  LLVMModuleRef module = llvm_emit_module(c, ast, source_file, machine);
+  c->defined_fns = NULL;
+  c->defined_fn_count = 0;
+  c->global_linkage = LLVMExternalLinkage;
+  return module;
+}
+
+// Declare every top-level function up front so calls may precede the callee
+void llvm_declare_functions(SmlCompiler *c, StmtBlock block) {
+  for (uint32_t i = 0; i < block.stmt_count; ++i) {
+    const StmtNode *stmt =
+        &c->ast->stmts.items[AST_BlockStmt(c->ast, block, i)];
+    if (stmt->type != STMT_FN_DECL) {
+      continue;
+    }
+    const StmtFnDecl *decl = &c->ast->fn_decls.items[stmt->index];
+    if (LLVMGetNamedFunction(c->module, decl->name)) {
+      Diagnostics_Error(&c->diag, "Redefinition of function %s", decl->name);
+      llvm_bail(c);
+    }
+    LLVMTypeRef fn_ret_type = sml_to_llvm_type(c, decl->return_type);
+    LLVMTypeRef fn_prototype = LLVMFunctionType(fn_ret_type, NULL, 0, 0);
+    LLVMAddFunction(c->module, decl->name, fn_prototype);
+  }
+}
+
+void llvm_emit_stmt_block(SmlCompiler *c, StmtBlock block) {
+  for (uint32_t i = 0; i < block.stmt_count; ++i) {
+    const StmtNode *stmt =
+        &c->ast->stmts.items[AST_BlockStmt(c->ast, block, i)];
+    switch (stmt->type) {
+    case STMT_FN_DECL: {
+      const StmtFnDecl *decl = &c->ast->fn_decls.items[stmt->index];
+      if (llvm_defines(c, decl)) {
+        // a bail leaves it to llvm_emit_module's Timing_Unwind
+        TimingScope timing = Timing_Begin("function", decl->name);
+        llvm_emit_stmt_function(c, decl);
+        Timing_End(timing);
+      }
       break;
+    }
     case STMT_VAR_DECL:
-      llvm_emit_stmt_vardecl(stmt.value.var_decl);
+      // global initializers are constants, never code in the last function
+      LLVMClearInsertionPosition(c->builder);
+      llvm_emit_stmt_vardecl(c, &c->ast->var_decls.items[stmt->index]);
       break;
     default:
-      puts("Only top level stmt is allowed at global scope\n");
-      exit(1);
+      Diagnostics_Error(&c->diag,
+                        "Only top level stmt is allowed at global scope");
+      llvm_bail(c);
     }
   }
 }
 
-void llvm_emit_stmt_function(StmtFnDecl decl) {
-  LLVMTypeRef fn_ret_type = sml_to_llvm_type(decl.return_type);
-  LLVMTypeRef fn_prototype = LLVMFunctionType(fn_ret_type, NULL, 0, 0);
-  LLVMValueRef fn = LLVMAddFunction(llvm_module, decl.name, fn_prototype);
-  LLVMBasicBlockRef fn_body = LLVMAppendBasicBlock(fn, "");
-  LLVMPositionBuilderAtEnd(llvm_builder, fn_body);
+void llvm_emit_stmt_function(SmlCompiler *c, const StmtFnDecl *decl) {
+  LLVMValueRef fn = LLVMGetNamedFunction(c->module, decl->name);
+  if (c->target_cpu) {
+    LLVMAddAttributeAtIndex(fn, LLVMAttributeFunctionIndex, c->target_cpu);
+  }
+  if (c->target_features) {
+    LLVMAddAttributeAtIndex(fn, LLVMAttributeFunctionIndex,
+                            c->target_features);
+  }
+  LLVMBasicBlockRef fn_body =
+      LLVMAppendBasicBlockInContext(c->context, fn, "");
+  LLVMPositionBuilderAtEnd(c->builder, fn_body);
 
-  for (size_t i = 0; i < decl.body.stmt_count; ++i) {
-    Stmt stmt = decl.body.stmts[i];
-    switch (stmt.type) {
+  for (uint32_t i = 0; i < decl->body.stmt_count; ++i) {
+    const StmtNode *stmt =
+        &c->ast->stmts.items[AST_BlockStmt(c->ast, decl->body, i)];
+    switch (stmt->type) {
     case STMT_RETURN: {
-      LLVMValueRef val = llvm_emit_stmt_expr(stmt.value.return_.operand);
-      LLVMBuildRet(llvm_builder, val);
+      const StmtReturn *ret = &c->ast->returns.items[stmt->index];
+      LLVMValueRef val = llvm_emit_stmt_expr(c, ret->operand);
+      LLVMBuildRet(c->builder, val);
       break;
     }
     case STMT_EXPR: {
-      LLVMValueRef _ = llvm_emit_stmt_expr(stmt.value.expr);
+      LLVMValueRef _ = llvm_emit_stmt_expr(c, stmt->index);
       break;
     }
     default:
-      puts("Top level stmt not allowed inside function\n");
-      exit(1);
+      Diagnostics_Error(&c->diag,
+                        "Top level stmt not allowed inside function");
+      llvm_bail(c);
     }
   }
 }
 
-void llvm_emit_stmt_vardecl(StmtVarDecl var_decl) {
-  LLVMValueRef llvm_init_val = llvm_emit_stmt_expr(*var_decl.init);
+void llvm_emit_stmt_vardecl(SmlCompiler *c, const StmtVarDecl *var_decl) {
+  LLVMValueRef llvm_init_val = llvm_emit_stmt_expr(c, var_decl->init);
 
   if (LLVMIsConstantString(llvm_init_val)) {
     size_t str_len = 0;
     const char *str = LLVMGetAsString(llvm_init_val, &str_len);
-    LLVMTypeRef llvm_str_type = LLVMArrayType2(LLVMInt8Type(), str_len);
+    LLVMTypeRef llvm_str_type =
+        LLVMArrayType2(LLVMInt8TypeInContext(c->context), str_len);
     LLVMValueRef llvm_str =
-        LLVMAddGlobal(llvm_module, llvm_str_type, var_decl.name);
+        LLVMAddGlobal(c->module, llvm_str_type, var_decl->name);
     LLVMSetInitializer(llvm_str, llvm_init_val);
+    LLVMSetLinkage(llvm_str, c->global_linkage);
   }
 
   if (LLVMIsAConstantInt(llvm_init_val)) {
-    LLVMValueRef llvm_int =
-        LLVMAddGlobal(llvm_module, LLVMInt32Type(), var_decl.name);
+    LLVMValueRef llvm_int = LLVMAddGlobal(
+        c->module, LLVMInt32TypeInContext(c->context), var_decl->name);
     LLVMSetInitializer(llvm_int, llvm_init_val);
+    LLVMSetLinkage(llvm_int, c->global_linkage);
   }
 }
 
-LLVMValueRef llvm_emit_stmt_expr(StmtExpr expr) {
-  switch (expr.type) {
-  case EXPR_LITERAL:
-    return llvm_emit_expr_literal(expr.value.literal);
-  case EXPR_CALL:
-    return llvm_emit_expr_call(expr.value.call);
-  case EXPR_BINOP:
-    return llvm_emit_expr_binop(expr.value.binop);
-  case EXPR_IDENT:
-    return llvm_emit_expr_ident(expr.value.ident);
-    break;
+/*
+ * Post-order walk over the expression with explicit frame and value stacks,
+ * so deeply nested expressions can't overflow the machine stack. Operands
+ * are emitted left to right before their parent, as recursion would.
+ */
+LLVMValueRef llvm_emit_stmt_expr(SmlCompiler *c, ExprId id) {
+  const AST *ast = c->ast;
+  size_t base = c->emit_frame_count;
+  emit_push_frame(c, id);
+
+  while (c->emit_frame_count > base) {
+    EmitFrame *frame = &c->emit_frames[c->emit_frame_count - 1];
+    const ExprNode *expr = &ast->exprs.items[frame->id];
+    LLVMValueRef value = NULL;
+
+    switch (expr->type) {
+    case EXPR_LITERAL:
+      value = llvm_emit_expr_literal(c, &ast->literals.items[expr->index]);
+      break;
+    case EXPR_IDENT:
+      value = llvm_emit_expr_ident(c, &ast->idents.items[expr->index]);
+      break;
+    case EXPR_CALL: {
+      const ExprCall *call = &ast->calls.items[expr->index];
+      if (frame->step < call->argc) {
+        emit_push_frame(c, AST_CallArg(ast, call, frame->step++));
+        continue;
+      }
+      c->emit_value_count -= call->argc;
+      value = llvm_emit_expr_call(c, call,
+                                  c->emit_values + c->emit_value_count);
+      break;
+    }
+    case EXPR_BINOP: {
+      const ExprBinOp *binop = &ast->binops.items[expr->index];
+      if (frame->step < 2) {
+        emit_push_frame(c, frame->step++ ? binop->rhs : binop->lhs);
+        continue;
+      }
+      c->emit_value_count -= 2;
+      value = llvm_emit_expr_binop(c, binop,
+                                   c->emit_values[c->emit_value_count],
+                                   c->emit_values[c->emit_value_count + 1]);
+      break;
+    }
+    }
+
+    c->emit_frame_count--;
+    emit_push_value(c, value);
   }
+
+  return c->emit_values[--c->emit_value_count];
 }
 
-LLVMValueRef llvm_emit_expr_call(ExprCall call_expr) {
-  BuiltinFn *called_fn = find_builtin_fn(stdlib, call_expr.name);
+// Takes ownership of value, an LLVM message; NULL if value is empty
+static LLVMAttributeRef string_attribute(SmlCompiler *c, const char *kind,
+                                         char *value) {
+  LLVMAttributeRef attribute = NULL;
+  if (*value) {
+    attribute = LLVMCreateStringAttribute(c->context, kind, strlen(kind),
+                                          value, strlen(value));
+  }
+  LLVMDisposeMessage(value);
+  return attribute;
+}
 
-  assert(called_fn && "Calling non-defined function\n");
-  assert(called_fn->prototype.param_count == call_expr.args.argc &&
-         "Args count miss match\n");
+// Every function, unless llvm_emit_functions restricted the set
+static bool llvm_defines(SmlCompiler *c, const StmtFnDecl *decl) {
+  if (!c->defined_fns) {
+    return true;
+  }
+  for (size_t i = 0; i < c->defined_fn_count; ++i) {
+    if (c->defined_fns[i] == decl) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  LLVMTypeRef llvm_ret_type =
-      sml_to_llvm_type(called_fn->prototype.return_type);
+static void llvm_bail(SmlCompiler *c) { longjmp(*c->bail, 1); }
 
-  LLVMTypeRef llvm_params[called_fn->prototype.param_count];
-  for (size_t i = 0; i < called_fn->prototype.param_count; ++i) {
-    llvm_params[i] = sml_to_llvm_type(called_fn->prototype.param_types[i]);
+static size_t llvm_instruction_count(LLVMModuleRef module) {
+  size_t count = 0;
+  for (LLVMValueRef fn = LLVMGetFirstFunction(module); fn;
+       fn = LLVMGetNextFunction(fn)) {
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(fn); block;
+         block = LLVMGetNextBasicBlock(block)) {
+      for (LLVMValueRef instr = LLVMGetFirstInstruction(block); instr;
+           instr = LLVMGetNextInstruction(instr)) {
+        count++;
+      }
+    }
   }
+  return count;
+}
 
-  LLVMTypeRef llvm_fn_type = LLVMFunctionType(
-      llvm_ret_type, llvm_params, called_fn->prototype.param_count, 1);
-  LLVMValueRef llvm_called_fn =
-      LLVMAddFunction(llvm_module, called_fn->prototype.name, llvm_fn_type);
+static void emit_push_frame(SmlCompiler *c, ExprId id) {
+  if (c->emit_frame_count == c->emit_frame_capacity) {
+    c->emit_frame_capacity =
+        c->emit_frame_capacity ? c->emit_frame_capacity * 2 : 16;
+    c->emit_frames = Mem_Realloc(c->emit_frames,
+                                 sizeof(EmitFrame) * c->emit_frame_capacity);
+    if (!c->emit_frames) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  c->emit_frames[c->emit_frame_count++] = (EmitFrame){.id = id, .step = 0};
+}
+
+static void emit_push_value(SmlCompiler *c, LLVMValueRef value) {
+  if (c->emit_value_count == c->emit_value_capacity) {
+    c->emit_value_capacity =
+        c->emit_value_capacity ? c->emit_value_capacity * 2 : 16;
+    c->emit_values = Mem_Realloc(
+        c->emit_values, sizeof(LLVMValueRef) * c->emit_value_capacity);
+    if (!c->emit_values) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  c->emit_values[c->emit_value_count++] = value;
+}
+
+// args holds the already emitted arguments, in order
+LLVMValueRef llvm_emit_expr_call(SmlCompiler *c, const ExprCall *call_expr,
+                                 LLVMValueRef *args) {
+  BuiltinFn *called_fn = find_builtin_fn(c->stdlib, call_expr->name);
+  if (!called_fn) {
+    return llvm_emit_expr_user_call(c, call_expr);
+  }
 
-  LLVMValueRef llvm_args[call_expr.args.argc];
+  if (called_fn->prototype.param_count != call_expr->argc) {
+    Diagnostics_Error(&c->diag, "%s takes %zu arguments", call_expr->name,
+                      called_fn->prototype.param_count);
+    llvm_bail(c);
+  }
+
+  LLVMTypeRef llvm_fn_type;
+  LLVMValueRef llvm_called_fn = llvm_builtin_decl(c, called_fn, &llvm_fn_type);
+
+  LLVMValueRef llvm_args[call_expr->argc];
 
-  for (size_t i = 0; i < call_expr.args.argc; ++i) {
-    LLVMValueRef llvm_arg = llvm_emit_stmt_expr(call_expr.args.argv[i]);
+  for (size_t i = 0; i < call_expr->argc; ++i) {
+    LLVMValueRef llvm_arg = args[i];
 
     if (LLVMIsConstantString(llvm_arg)) {
-      size_t str_len = 0;
-      const char *str = LLVMGetAsString(llvm_arg, &str_len);
-      llvm_args[i] = LLVMBuildGlobalString(llvm_builder, str, "str");
+      llvm_args[i] = llvm_string_ptr(c, llvm_arg);
       continue;
     }
 
-    if (LLVMIsAConstantInt(llvm_arg)) {
+    // ints and string variables are passed as they are
+    LLVMTypeKind kind = LLVMGetTypeKind(LLVMTypeOf(llvm_arg));
+    if (kind == LLVMIntegerTypeKind || kind == LLVMPointerTypeKind) {
       llvm_args[i] = llvm_arg;
       continue;
     }
 
-    fprintf(stderr, "[Error] Unsupported argument\n");
-    exit(1);
+    Diagnostics_Error(&c->diag, "Unsupported argument");
+    llvm_bail(c);
   }
 
   LLVMValueRef llvm_call =
-      LLVMBuildCall2(llvm_builder, llvm_fn_type, llvm_called_fn, llvm_args,
-                     call_expr.args.argc, "");
+      LLVMBuildCall2(c->builder, llvm_fn_type, llvm_called_fn, llvm_args,
+                     call_expr->argc, "");
   return llvm_call;
 }
 
-LLVMValueRef llvm_emit_expr_binop(ExprBinOp binop) {
-  LLVMValueRef llvm_lhs = llvm_emit_stmt_expr(*binop.lhs);
-  LLVMValueRef llvm_rhs = llvm_emit_stmt_expr(*binop.rhs);
+// Declared on the module's first call, adding it again would get a renamed
+// copy
+static LLVMValueRef llvm_builtin_decl(SmlCompiler *c, const BuiltinFn *fn,
+                                      LLVMTypeRef *type) {
+  size_t index = fn - c->stdlib->builtin_fns;
+  if (c->builtin_decls[index]) {
+    *type = c->builtin_types[index];
+    return c->builtin_decls[index];
+  }
 
+  LLVMTypeRef llvm_ret_type = sml_to_llvm_type(c, fn->prototype.return_type);
+  LLVMTypeRef llvm_params[fn->prototype.param_count + 1];
+  for (size_t i = 0; i < fn->prototype.param_count; ++i) {
+    llvm_params[i] = sml_to_llvm_type(c, fn->prototype.param_types[i]);
+  }
+  *type = LLVMFunctionType(llvm_ret_type, llvm_params,
+                           fn->prototype.param_count, 1);
+  LLVMValueRef decl = LLVMGetNamedFunction(c->module, fn->prototype.name);
+  if (!decl) {
+    decl = LLVMAddFunction(c->module, fn->prototype.name, *type);
+  }
+  c->builtin_types[index] = *type;
+  c->builtin_decls[index] = decl;
+  return decl;
+}
+
+/*
+ * One private unnamed_addr constant per distinct literal of the module, so
+ * a thousand print("...\n") of the same text share one global, and the
+ * linker may merge it with equal ones of other modules.
+ */
+static LLVMValueRef llvm_string_ptr(SmlCompiler *c, LLVMValueRef constant) {
+  // kept at most half full
+  if ((c->emit_string_count + 1) * 2 > c->emit_string_capacity) {
+    size_t old_capacity = c->emit_string_capacity;
+    EmitString *old = c->emit_strings;
+    c->emit_string_capacity = old_capacity ? old_capacity * 2 : 64;
+    c->emit_strings = Mem_Alloc(sizeof(EmitString) * c->emit_string_capacity);
+    if (!c->emit_strings) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+    memset(c->emit_strings, 0, sizeof(EmitString) * c->emit_string_capacity);
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old[i].text) {
+        *string_slot(c, old[i].text, old[i].len) = old[i];
+      }
+    }
+    Mem_Free(old);
+  }
+
+  size_t len;
+  const char *text = LLVMGetAsString(constant, &len);
+  EmitString *slot = string_slot(c, text, len);
+  if (!slot->text) {
+    LLVMValueRef global =
+        LLVMAddGlobal(c->module, LLVMTypeOf(constant), ".str");
+    LLVMSetInitializer(global, constant);
+    LLVMSetLinkage(global, LLVMPrivateLinkage);
+    LLVMSetUnnamedAddress(global, LLVMGlobalUnnamedAddr);
+    LLVMSetGlobalConstant(global, 1);
+    LLVMSetAlignment(global, 1);
+    *slot = (EmitString){
+        .text = text,
+        .len = len,
+        .ptr = LLVMConstPointerCast(global, sml_to_llvm_type(c, TYPE_STR)),
+    };
+    c->emit_string_count++;
+  }
+  return slot->ptr;
+}
+
+// The slot holding text, or the empty one it goes in
+static EmitString *string_slot(SmlCompiler *c, const char *text,
+                               size_t len) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ (unsigned char)text[i]) * 1099511628211ULL;
+  }
+  size_t mask = c->emit_string_capacity - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    EmitString *slot = &c->emit_strings[i];
+    if (!slot->text ||
+        (slot->len == len && memcmp(slot->text, text, len) == 0)) {
+      return slot;
+    }
+  }
+}
+
+// Every module starts without declarations or literals
+static void llvm_reset_module_caches(SmlCompiler *c) {
+  memset(c->builtin_decls, 0,
+         sizeof(LLVMValueRef) * c->stdlib->builtin_fns_count);
+  if (c->emit_strings) {
+    memset(c->emit_strings, 0, sizeof(EmitString) * c->emit_string_capacity);
+  }
+  c->emit_string_count = 0;
+}
+
+// Functions of the program itself, all declared by llvm_declare_functions
+LLVMValueRef llvm_emit_expr_user_call(SmlCompiler *c,
+                                      const ExprCall *call_expr) {
+  LLVMValueRef llvm_fn = LLVMGetNamedFunction(c->module, call_expr->name);
+  if (!llvm_fn) {
+    Diagnostics_Error(&c->diag, "Call to undefined function %s",
+                      call_expr->name);
+    llvm_bail(c);
+  }
+  if (call_expr->argc != 0) {
+    Diagnostics_Error(&c->diag, "Function %s takes no arguments",
+                      call_expr->name);
+    llvm_bail(c);
+  }
+  return LLVMBuildCall2(c->builder, LLVMGlobalGetValueType(llvm_fn), llvm_fn,
+                        NULL, 0, "");
+}
+
+LLVMValueRef llvm_emit_expr_binop(SmlCompiler *c, const ExprBinOp *binop,
+                                  LLVMValueRef llvm_lhs,
+                                  LLVMValueRef llvm_rhs) {
   LLVMValueRef llvm_binop;
-  switch (binop.op) {
+  switch (binop->op) {
   case BINOP_PLUS:
-    llvm_binop = LLVMBuildAdd(llvm_builder, llvm_lhs, llvm_rhs, "");
+    llvm_binop = LLVMBuildAdd(c->builder, llvm_lhs, llvm_rhs, "");
     break;
   }
 
   return llvm_binop;
 }
 
-LLVMValueRef llvm_emit_expr_literal(ExprLiteral literal) {
-  switch (literal.type) {
+LLVMValueRef llvm_emit_expr_literal(SmlCompiler *c,
+                                    const ExprLiteral *literal) {
+  switch (literal->type) {
   case EXPR_LITERAL_NUM:
-    return LLVMConstInt(LLVMInt32Type(), literal.value.number, 0);
+    return LLVMConstInt(LLVMInt32TypeInContext(c->context),
+                        literal->value.number, 0);
   case EXPR_LITERAL_STR: {
-    char *unescaped_str = unescape_str(literal.value.string);
-    return LLVMConstString(unescaped_str, strlen(unescaped_str), 0);
+    char *unescaped_str = unescape_str(literal->value.string);
+    LLVMValueRef str = LLVMConstStringInContext(
+        c->context, unescaped_str, strlen(unescaped_str), 0);
+    Mem_Free(unescaped_str);
+    return str;
   }
   }
 }
 
-LLVMValueRef llvm_emit_expr_ident(ExprIdent ident) {
-  return LLVMGetNamedGlobal(llvm_module, ident.label);
+// Globals are never reassigned, so outside a function the initializer is
+// the value. Inside one, ints are loaded and strings decay to a pointer.
+LLVMValueRef llvm_emit_expr_ident(SmlCompiler *c, const ExprIdent *ident) {
+  LLVMValueRef global = LLVMGetNamedGlobal(c->module, ident->label);
+  if (!global) {
+    Diagnostics_Error(&c->diag, "Undefined variable %s", ident->label);
+    llvm_bail(c);
+  }
+  if (!LLVMGetInsertBlock(c->builder)) {
+    return LLVMGetInitializer(global);
+  }
+
+  LLVMTypeRef type = LLVMGlobalGetValueType(global);
+  if (LLVMGetTypeKind(type) == LLVMArrayTypeKind) {
+    return LLVMConstPointerCast(global, sml_to_llvm_type(c, TYPE_STR));
+  }
+  return LLVMBuildLoad2(c->builder, type, global, "");
 }
 
-LLVMTypeRef sml_to_llvm_type(Type type) {
+LLVMTypeRef sml_to_llvm_type(SmlCompiler *c, Type type) {
   switch (type) {
   case TYPE_INT:
-    return LLVMInt32Type();
+    return LLVMInt32TypeInContext(c->context);
   case TYPE_STR:
-    return LLVMPointerType(LLVMInt8Type(), 0);
+    return LLVMPointerType(LLVMInt8TypeInContext(c->context), 0);
   }
 }
@@ -1,10 +1,48 @@
 #ifndef LLVM_CODE_GEN
 #define LLVM_CODE_GEN
 
+#include <llvm-c/TargetMachine.h>
 #include <llvm-c/Types.h>
 
 #include "ast.h"
+#include "cache.h"
+#include "compiler.h"
+#include "thread_pool.h"
 
-LLVMModuleRef llvm_emit_module(AST ast, char *source_file);
+// The module and everything in it is created in the compiler's context.
+// Every function defined gets the machine's CPU and features as
+// target-cpu/target-features attributes; machine may be NULL to leave them
+// unset. NULL if the program is invalid, the reasons are in c->diag.
+LLVMModuleRef llvm_emit_module(SmlCompiler *c, const AST *ast,
+                               char *source_file,
+                               LLVMTargetMachineRef machine);
+
+// Same, but only the bodies of fns are emitted; the program's other functions
+// are left as declarations. Globals get the given linkage: internal for a
+// private copy, available_externally when another module defines them.
+LLVMModuleRef llvm_emit_functions(SmlCompiler *c, const AST *ast,
+                                  char *source_file,
+                                  LLVMTargetMachineRef machine,
+                                  const StmtFnDecl *const *fns,
+                                  size_t fn_count, LLVMLinkage globals);
+
+// Emit and optimize the program with its functions split into one partition
+// per thread of the pool, each by its own compiler in its own context with
+// its own target machine (cpu and features as for Backend_NewTargetMachine).
+// The optimized partitions are linked into one module created in c's
+// context; NULL if a partition fails, with the reasons in c->diag.
+LLVMModuleRef llvm_emit_module_parallel(SmlCompiler *c, const AST *ast,
+                                        char *source_file, const char *cpu,
+                                        const char *features, int opt_level,
+                                        const char *passes, ThreadPool *pool);
+
+// Emit and optimize each function on its own, or load it from the cache when
+// nothing it depends on changed, and link them into one module created in
+// c's context with the program's globals. NULL on error, reasons in c->diag.
+LLVMModuleRef llvm_emit_module_cached(SmlCompiler *c, const AST *ast,
+                                      char *source_file,
+                                      LLVMTargetMachineRef machine,
+                                      int opt_level, const char *passes,
+                                      Cache *cache);
 
 #endif
@@ -0,0 +1,354 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Linker.h>
+#include <llvm/Config/llvm-config.h>
+
+#include "backend.h"
+#include "cache.h"
+#include "compiler.h"
+#include "llvm_gen.h"
+
+// A top-level declaration as names resolve to it: functions are visible
+// everywhere, globals only after their declaration
+typedef struct CachedName {
+  const char *name;
+  uint32_t position; // in the root block
+  const StmtFnDecl *fn; // NULL for a global
+  CacheHash value; // of a global's initializer, globals it reads resolved
+} CachedName;
+
+typedef struct CachedProgram {
+  const AST *ast;
+  const StdLib *stdlib;
+  CachedName *names; // sorted by name, then position
+  size_t name_count;
+  ExprId *stack;
+  size_t stack_capacity;
+} CachedProgram;
+
+static CacheHash toolchain_hash(LLVMTargetMachineRef machine, int opt_level,
+                                const char *passes);
+static void hash_expr(CachedProgram *, CacheHash *, ExprId, uint32_t position);
+static size_t first_named(const CachedProgram *, const char *name);
+static const CachedName *resolve(const CachedProgram *, const char *name,
+                                 uint32_t position, bool fn);
+static void stack_push(CachedProgram *, size_t *count, ExprId);
+static int compare_names(const void *a, const void *b);
+static LLVMModuleRef emit_function(SmlCompiler *scratch, SmlCompiler *c,
+                                   const AST *ast, char *source_file,
+                                   LLVMTargetMachineRef machine,
+                                   const StmtFnDecl *decl, int opt_level,
+                                   const char *passes, Cache *cache,
+                                   CacheHash key);
+
+/*
+ * Each function is emitted and optimized in a module of its own, whose
+ * bitcode is cached under a hash of everything that can change it: the
+ * toolchain and flags, the function itself, and how each name it uses
+ * resolves (a callee's return type, a global's initializer). Globals are
+ * cheap and always emitted, into the module the functions are linked into.
+ */
+LLVMModuleRef llvm_emit_module_cached(SmlCompiler *c, const AST *ast,
+                                      char *source_file,
+                                      LLVMTargetMachineRef machine,
+                                      int opt_level, const char *passes,
+                                      Cache *cache) {
+  CachedProgram program = {.ast = ast, .stdlib = c->stdlib};
+  program.names = malloc(sizeof(CachedName) * (ast->root.stmt_count + 1));
+  const StmtFnDecl **fns =
+      malloc(sizeof(StmtFnDecl *) * (ast->fn_decls.count + 1));
+  uint32_t *fn_positions = malloc(sizeof(uint32_t) * (ast->fn_decls.count + 1));
+  if (!program.names || !fns || !fn_positions) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  size_t fn_count = 0;
+  for (uint32_t i = 0; i < ast->root.stmt_count; ++i) {
+    const StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, ast->root, i)];
+    if (stmt->type == STMT_FN_DECL) {
+      const StmtFnDecl *decl = &ast->fn_decls.items[stmt->index];
+      program.names[program.name_count++] =
+          (CachedName){.name = decl->name, .position = i, .fn = decl};
+      fn_positions[fn_count] = i;
+      fns[fn_count++] = decl;
+    } else if (stmt->type == STMT_VAR_DECL) {
+      program.names[program.name_count++] = (CachedName){
+          .name = ast->var_decls.items[stmt->index].name, .position = i};
+    }
+  }
+  qsort(program.names, program.name_count, sizeof(CachedName), compare_names);
+
+  // initializers only read earlier globals, so one pass in source order
+  // finds every value it needs already hashed
+  for (uint32_t i = 0; i < ast->root.stmt_count; ++i) {
+    const StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, ast->root, i)];
+    if (stmt->type != STMT_VAR_DECL) {
+      continue;
+    }
+    const StmtVarDecl *var_decl = &ast->var_decls.items[stmt->index];
+    CachedName *name = &program.names[first_named(&program, var_decl->name)];
+    while (name->position != i) {
+      name++;
+    }
+    name->value = CacheHash_New();
+    hash_expr(&program, &name->value, var_decl->init, i);
+  }
+
+  // globals are defined here, every function is only declared
+  LLVMModuleRef module = llvm_emit_functions(c, ast, source_file, machine, fns,
+                                             0, LLVMExternalLinkage);
+  if (module) {
+    Backend_SetTarget(module, machine);
+    if (Backend_Optimize(module, machine, opt_level, passes, &c->diag) != 0) {
+      LLVMDisposeModule(module);
+      module = NULL;
+    }
+  }
+
+  CacheHash toolchain = toolchain_hash(machine, opt_level, passes);
+  SmlCompiler scratch;
+  bool scratch_ready = false;
+  for (size_t f = 0; f < fn_count && module; ++f) {
+    const StmtFnDecl *decl = fns[f];
+    CacheHash key = toolchain;
+    CacheHash_String(&key, decl->name);
+    CacheHash_U64(&key, decl->return_type);
+    CacheHash_U64(&key, decl->body.stmt_count);
+    for (uint32_t s = 0; s < decl->body.stmt_count; ++s) {
+      const StmtNode *stmt =
+          &ast->stmts.items[AST_BlockStmt(ast, decl->body, s)];
+      CacheHash_U64(&key, stmt->type);
+      if (stmt->type == STMT_RETURN) {
+        hash_expr(&program, &key, ast->returns.items[stmt->index].operand,
+                  fn_positions[f]);
+      } else if (stmt->type == STMT_EXPR) {
+        hash_expr(&program, &key, stmt->index, fn_positions[f]);
+      }
+    }
+
+    LLVMModuleRef partition = NULL;
+    LLVMMemoryBufferRef bitcode = Cache_Load(cache, key);
+    if (bitcode) {
+      // a damaged entry is rebuilt like a miss
+      if (LLVMParseBitcodeInContext2(c->context, bitcode, &partition)) {
+        partition = NULL;
+        cache->stats.hits--;
+        cache->stats.misses++;
+      }
+      LLVMDisposeMemoryBuffer(bitcode);
+    }
+    if (!partition) {
+      if (!scratch_ready) {
+        SmlCompiler_Init(&scratch, NULL, NULL);
+        scratch_ready = true;
+      }
+      partition = emit_function(&scratch, c, ast, source_file, machine, decl,
+                                opt_level, passes, cache, key);
+    }
+    // consumes the partition
+    if (!partition || LLVMLinkModules2(module, partition)) {
+      if (partition) {
+        Diagnostics_Error(&c->diag, "Unable to link function %s", decl->name);
+      }
+      LLVMDisposeModule(module);
+      module = NULL;
+    }
+  }
+
+  if (scratch_ready) {
+    SmlCompiler_Free(&scratch);
+  }
+  free(program.stack);
+  free(program.names);
+  free(fns);
+  free(fn_positions);
+  return module;
+}
+
+// Emitted in the scratch compiler's context, handed over as bitcode
+static LLVMModuleRef emit_function(SmlCompiler *scratch, SmlCompiler *c,
+                                   const AST *ast, char *source_file,
+                                   LLVMTargetMachineRef machine,
+                                   const StmtFnDecl *decl, int opt_level,
+                                   const char *passes, Cache *cache,
+                                   CacheHash key) {
+  LLVMModuleRef module =
+      llvm_emit_functions(scratch, ast, source_file, machine, &decl, 1,
+                          LLVMAvailableExternallyLinkage);
+  Diagnostics_Append(&c->diag, &scratch->diag);
+  Diagnostics_Clear(&scratch->diag);
+  if (!module) {
+    return NULL;
+  }
+
+  Backend_SetTarget(module, machine);
+  LLVMMemoryBufferRef bitcode = NULL;
+  if (Backend_Optimize(module, machine, opt_level, passes, &c->diag) == 0) {
+    bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+  }
+  LLVMDisposeModule(module);
+  if (!bitcode) {
+    return NULL;
+  }
+
+  Cache_Store(cache, key, LLVMGetBufferStart(bitcode),
+              LLVMGetBufferSize(bitcode));
+  LLVMModuleRef partition = NULL;
+  if (LLVMParseBitcodeInContext2(c->context, bitcode, &partition)) {
+    Diagnostics_Error(&c->diag, "Unable to read back function %s",
+                      decl->name);
+    partition = NULL;
+  }
+  LLVMDisposeMemoryBuffer(bitcode);
+  return partition;
+}
+
+// Anything that changes code for the same source: this build of sml, LLVM,
+// the target and the optimization flags
+static CacheHash toolchain_hash(LLVMTargetMachineRef machine, int opt_level,
+                                const char *passes) {
+  CacheHash hash = CacheHash_New();
+  CacheHash_U64(&hash, SML_CACHE_FORMAT);
+  CacheHash_String(&hash, LLVM_VERSION_STRING);
+  struct stat exe;
+  if (stat("/proc/self/exe", &exe) == 0) {
+    CacheHash_U64(&hash, exe.st_size);
+    CacheHash_U64(&hash, exe.st_mtim.tv_sec);
+    CacheHash_U64(&hash, exe.st_mtim.tv_nsec);
+  }
+
+  char *triple = LLVMGetTargetMachineTriple(machine);
+  char *cpu = LLVMGetTargetMachineCPU(machine);
+  char *features = LLVMGetTargetMachineFeatureString(machine);
+  CacheHash_String(&hash, triple);
+  CacheHash_String(&hash, cpu);
+  CacheHash_String(&hash, features);
+  LLVMDisposeMessage(triple);
+  LLVMDisposeMessage(cpu);
+  LLVMDisposeMessage(features);
+
+  CacheHash_U64(&hash, opt_level);
+  CacheHash_String(&hash, passes ? passes : "");
+  return hash;
+}
+
+// Pre-order, every node hashed with its arity so the shape is unambiguous
+static void hash_expr(CachedProgram *program, CacheHash *hash, ExprId id,
+                      uint32_t position) {
+  const AST *ast = program->ast;
+  size_t count = 0;
+  stack_push(program, &count, id);
+
+  while (count > 0) {
+    const ExprNode *expr = &ast->exprs.items[program->stack[--count]];
+    CacheHash_U64(hash, expr->type);
+    switch (expr->type) {
+    case EXPR_LITERAL: {
+      const ExprLiteral *literal = &ast->literals.items[expr->index];
+      CacheHash_U64(hash, literal->type);
+      if (literal->type == EXPR_LITERAL_STR) {
+        CacheHash_String(hash, literal->value.string);
+      } else {
+        CacheHash_U64(hash, literal->value.number);
+      }
+      break;
+    }
+    case EXPR_IDENT: {
+      const char *label = ast->idents.items[expr->index].label;
+      const CachedName *global = resolve(program, label, position, false);
+      CacheHash_String(hash, label);
+      CacheHash_U64(hash, global != NULL);
+      if (global) {
+        CacheHash_Bytes(hash, &global->value, sizeof(global->value));
+      }
+      break;
+    }
+    case EXPR_CALL: {
+      const ExprCall *call = &ast->calls.items[expr->index];
+      const CachedName *fn = resolve(program, call->name, position, true);
+      CacheHash_String(hash, call->name);
+      CacheHash_U64(hash, call->argc);
+      // builtins take precedence, as in llvm_emit_expr_call
+      if (find_builtin_fn(program->stdlib, call->name)) {
+        CacheHash_U64(hash, 1);
+      } else {
+        CacheHash_U64(hash, fn ? 2 + fn->fn->return_type : 0);
+      }
+      for (uint32_t i = call->argc; i > 0; --i) {
+        stack_push(program, &count, AST_CallArg(ast, call, i - 1));
+      }
+      break;
+    }
+    case EXPR_BINOP: {
+      const ExprBinOp *binop = &ast->binops.items[expr->index];
+      CacheHash_U64(hash, binop->op);
+      stack_push(program, &count, binop->rhs);
+      stack_push(program, &count, binop->lhs);
+      break;
+    }
+    }
+  }
+}
+
+// The first function of that name, or the first global declared before
+// position, as LLVMGetNamedFunction/LLVMGetNamedGlobal would find them
+static const CachedName *resolve(const CachedProgram *program,
+                                 const char *name, uint32_t position,
+                                 bool fn) {
+  for (size_t i = first_named(program, name); i < program->name_count &&
+                       strcmp(program->names[i].name, name) == 0;
+       ++i) {
+    const CachedName *found = &program->names[i];
+    if (fn && found->fn) {
+      return found;
+    }
+    if (!fn && !found->fn && found->position < position) {
+      return found;
+    }
+  }
+  return NULL;
+}
+
+// Lower bound of name in the sorted names
+static size_t first_named(const CachedProgram *program, const char *name) {
+  size_t low = 0, high = program->name_count;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (strcmp(program->names[mid].name, name) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static void stack_push(CachedProgram *program, size_t *count, ExprId id) {
+  if (*count == program->stack_capacity) {
+    program->stack_capacity =
+        program->stack_capacity ? program->stack_capacity * 2 : 64;
+    program->stack =
+        realloc(program->stack, sizeof(ExprId) * program->stack_capacity);
+    if (!program->stack) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  program->stack[(*count)++] = id;
+}
+
+static int compare_names(const void *a, const void *b) {
+  const CachedName *x = a, *y = b;
+  int order = strcmp(x->name, y->name);
+  if (order != 0) {
+    return order;
+  }
+  return x->position < y->position ? -1 : x->position > y->position;
+}
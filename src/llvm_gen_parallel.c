@@ -0,0 +1,185 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <llvm-c/BitReader.h>
+#include <llvm-c/BitWriter.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Linker.h>
+
+#include "backend.h"
+#include "compiler.h"
+#include "llvm_gen.h"
+#include "thread_pool.h"
+#include "timing.h"
+
+// A contiguous run of the program's functions, emitted and optimized in its
+// own context, handed back as bitcode since modules can't cross contexts
+typedef struct CodegenTask {
+  const AST *ast;
+  char *source_file;
+  const char *cpu;
+  const char *features;
+  int opt_level;
+  const char *passes;
+  const StmtFnDecl **fns;
+  size_t fn_count;
+  bool defines_globals;
+
+  LLVMMemoryBufferRef bitcode; // NULL if the partition failed
+  Diagnostics diag;
+} CodegenTask;
+
+static void codegen_task(void *arg);
+static int link_partition(SmlCompiler *c, LLVMModuleRef *dest,
+                          LLVMMemoryBufferRef bitcode);
+
+LLVMModuleRef llvm_emit_module_parallel(SmlCompiler *c, const AST *ast,
+                                        char *source_file, const char *cpu,
+                                        const char *features, int opt_level,
+                                        const char *passes, ThreadPool *pool) {
+  const StmtFnDecl **fns =
+      malloc(sizeof(StmtFnDecl *) * (ast->fn_decls.count + 1));
+  size_t fn_count = 0;
+  size_t total_stmts = 0;
+  for (uint32_t i = 0; i < ast->root.stmt_count; ++i) {
+    const StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, ast->root, i)];
+    if (stmt->type == STMT_FN_DECL) {
+      fns[fn_count] = &ast->fn_decls.items[stmt->index];
+      total_stmts += fns[fn_count]->body.stmt_count + 1;
+      fn_count++;
+    }
+  }
+
+  // Every partition declares all functions and emits every global, so an
+  // error there would come back once per partition. They are emitted alone
+  // first, here, and only function bodies can fail past this point.
+  LLVMModuleRef globals =
+      llvm_emit_functions(c, ast, source_file, NULL, fns, 0,
+                          LLVMExternalLinkage);
+  if (!globals) {
+    free(fns);
+    return NULL;
+  }
+  LLVMDisposeModule(globals);
+
+  // contiguous partitions of about the same number of statements keep the
+  // functions in source order once linked
+  size_t task_count = pool->thread_count < fn_count ? pool->thread_count
+                                                    : fn_count;
+  if (task_count == 0) {
+    task_count = 1;
+  }
+  CodegenTask *tasks = calloc(task_count, sizeof(CodegenTask));
+  size_t next = 0, done_stmts = 0;
+  for (size_t t = 0; t < task_count; ++t) {
+    size_t target = total_stmts * (t + 1) / task_count;
+    tasks[t] = (CodegenTask){
+        .ast = ast,
+        .source_file = source_file,
+        .cpu = cpu,
+        .features = features,
+        .opt_level = opt_level,
+        .passes = passes,
+        .fns = fns + next,
+        .defines_globals = t == 0,
+    };
+    // every partition gets at least one function, and leaves one for each
+    // partition after it
+    while (next < fn_count - (task_count - t - 1) &&
+           (tasks[t].fn_count == 0 || done_stmts < target)) {
+      done_stmts += fns[next++]->body.stmt_count + 1;
+      tasks[t].fn_count++;
+    }
+  }
+
+  for (size_t t = 0; t < task_count; ++t) {
+    ThreadPool_Submit(pool, codegen_task, &tasks[t]);
+  }
+  ThreadPool_Wait(pool);
+
+  LLVMModuleRef module = NULL;
+  int status = 0;
+  TimingScope timing = Timing_Begin("link", NULL);
+  for (size_t t = 0; t < task_count; ++t) {
+    // reported in partition order, not as the threads finished
+    Diagnostics_Append(&c->diag, &tasks[t].diag);
+    Diagnostics_Free(&tasks[t].diag);
+    if (!tasks[t].bitcode) {
+      status = 1;
+      continue;
+    }
+    if (status == 0) {
+      status = link_partition(c, &module, tasks[t].bitcode);
+    }
+    LLVMDisposeMemoryBuffer(tasks[t].bitcode);
+  }
+  Timing_End(timing);
+
+  free(tasks);
+  free(fns);
+  if (status != 0 && module) {
+    LLVMDisposeModule(module);
+    module = NULL;
+  }
+  return module;
+}
+
+static void codegen_task(void *arg) {
+  CodegenTask *task = arg;
+  TimingScope timing = Timing_Begin("partition", NULL);
+  task->diag = Diagnostics_New(NULL);
+  LLVMTargetMachineRef machine = Backend_NewTargetMachine(
+      task->opt_level, task->cpu, task->features, &task->diag);
+  if (!machine) {
+    Timing_End(timing);
+    return;
+  }
+
+  SmlCompiler compiler;
+  SmlCompiler_Init(&compiler, NULL, NULL);
+  // globals are defined by the first partition, the others only see their
+  // initializers
+  LLVMModuleRef module = llvm_emit_functions(
+      &compiler, task->ast, task->source_file, machine, task->fns,
+      task->fn_count,
+      task->defines_globals ? LLVMExternalLinkage
+                            : LLVMAvailableExternallyLinkage);
+  if (module) {
+    Backend_SetTarget(module, machine);
+    if (Backend_Optimize(module, machine, task->opt_level, task->passes,
+                         &compiler.diag) == 0) {
+      task->bitcode = LLVMWriteBitcodeToMemoryBuffer(module);
+    }
+    LLVMDisposeModule(module);
+  }
+
+  // handed to the caller, which echoes them in order
+  task->diag = compiler.diag;
+  compiler.diag = Diagnostics_New(NULL);
+  SmlCompiler_Free(&compiler);
+  LLVMDisposeTargetMachine(machine);
+  Timing_End(timing);
+}
+
+// The first partition becomes the module the others are linked into
+static int link_partition(SmlCompiler *c, LLVMModuleRef *dest,
+                          LLVMMemoryBufferRef bitcode) {
+  LLVMModuleRef partition;
+  if (LLVMParseBitcodeInContext2(c->context, bitcode, &partition)) {
+    Diagnostics_Error(&c->diag, "Unable to read back a codegen partition");
+    return 1;
+  }
+  if (!*dest) {
+    // bitcode doesn't keep the module's name
+    LLVMSetModuleIdentifier(partition, "hello", 5);
+    *dest = partition;
+    return 0;
+  }
+  // consumes the partition
+  if (LLVMLinkModules2(*dest, partition)) {
+    Diagnostics_Error(&c->diag, "Unable to link a codegen partition");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "mem.h"
+#include "timing.h"
+
+bool mem_enabled = false;
+// usable sizes, which is what the heap really spends
+static int64_t mem_live, mem_peak;
+
+static void mem_track(int64_t delta);
+
+void Mem_Enable(void) {
+  // the phases are timing scopes, recorded but only printed with
+  // --time-report
+  if (!timing_enabled) {
+    Timing_Enable();
+  }
+  Timing_TrackHeap();
+  mem_enabled = true;
+}
+
+void *Mem_Alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (mem_enabled && ptr) {
+    size_t usable = malloc_usable_size(ptr);
+    Timing_Allocated(usable);
+    mem_track(usable);
+  }
+  return ptr;
+}
+
+void *Mem_Realloc(void *ptr, size_t size) {
+  if (!mem_enabled) {
+    return realloc(ptr, size);
+  }
+  size_t before = ptr ? malloc_usable_size(ptr) : 0;
+  void *grown = realloc(ptr, size);
+  if (grown) {
+    size_t after = malloc_usable_size(grown);
+    // growing is charged as an allocation of the extra bytes
+    Timing_Allocated(after > before ? after - before : 0);
+    mem_track((int64_t)after - (int64_t)before);
+  }
+  return grown;
+}
+
+void Mem_Free(void *ptr) {
+  if (mem_enabled && ptr) {
+    mem_track(-(int64_t)malloc_usable_size(ptr));
+  }
+  free(ptr);
+}
+
+void Mem_Report(FILE *out) {
+  struct mallinfo2 heap = mallinfo2();
+  size_t heap_used = heap.uordblks + heap.hblkhd;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  int64_t live = __atomic_load_n(&mem_live, __ATOMIC_RELAXED);
+  int64_t peak = __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+
+  fprintf(out, "===== sml memory report =====\n");
+  // heap growth is process-wide, other threads' allocations land in it too
+  Timing_ReportMemory(out);
+  fprintf(out, "-- totals\n");
+  fprintf(out, "%12ld  peak RSS (KB)\n", usage.ru_maxrss);
+  fprintf(out, "%12zu  heap in use\n", heap_used);
+  fprintf(out, "%12lld  front end holds (peak %lld)\n", (long long)live,
+          (long long)peak);
+  fprintf(out, "%12lld  LLVM and the rest of the heap\n",
+          (long long)heap_used - (long long)live);
+}
+
+static void mem_track(int64_t delta) {
+  int64_t live =
+      __atomic_add_fetch(&mem_live, delta, __ATOMIC_RELAXED);
+  int64_t peak = __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+  while (live > peak &&
+         !__atomic_compare_exchange_n(&mem_peak, &peak, live, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
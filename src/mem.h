@@ -0,0 +1,27 @@
+#ifndef SML_MEM
+#define SML_MEM
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Allocator of the front end (sources, tokens, arenas, the AST, parser
+ * stacks and diagnostics) and of the compiler's own codegen tables and
+ * stacks. Same contract as malloc/realloc/free, whose
+ * memory it hands out, so either may free it. With --mem-report on, every
+ * allocation is charged to the caller's innermost timing scope and the
+ * bytes held are tracked; while off, it costs a branch.
+ */
+extern bool mem_enabled;
+
+void Mem_Enable(void);
+void *Mem_Alloc(size_t size);
+void *Mem_Realloc(void *ptr, size_t size);
+void Mem_Free(void *ptr);
+
+// Per phase, then peak RSS, what the front end holds and what the rest of
+// the heap, LLVM's contexts mostly, holds
+void Mem_Report(FILE *out);
+
+#endif
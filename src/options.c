@@ -0,0 +1,253 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "interp.h"
+#include "options.h"
+
+static int parse_arg(SmlArgs *, int argc, char **argv, int *i,
+                     Diagnostics *diag, bool *show_usage);
+static int parse_response(SmlArgs *, const char *path, Diagnostics *diag,
+                          bool *show_usage);
+static void add_source(SmlArgs *, char *path);
+
+int SmlArgs_Parse(SmlArgs *args, int argc, char **argv, Diagnostics *diag,
+                  bool *show_usage) {
+  memset(args, 0, sizeof(SmlArgs));
+  args->emit = EMIT_LL;
+  args->hot_calls = SML_HOT_CALLS;
+  args->cache_size_mb = SML_CACHE_SIZE_MB;
+  *show_usage = false;
+
+  // `sml run` executes the program in-process instead of writing output
+  args->run = argc > 0 && strcmp(argv[0], "run") == 0;
+
+  for (int i = args->run ? 1 : 0; i < argc; ++i) {
+    int status = argv[i][0] == '@'
+                     ? parse_response(args, argv[i] + 1, diag, show_usage)
+                     : parse_arg(args, argc, argv, &i, diag, show_usage);
+    if (status != 0) {
+      return status;
+    }
+  }
+  return 0;
+}
+
+const char *SmlArgs_LocalOnly(const SmlArgs *args) {
+  if (args->time_report) {
+    return "--time-report";
+  }
+  if (args->trace_file) {
+    return "--trace";
+  }
+  if (args->mem_report) {
+    return "--mem-report";
+  }
+  if (args->cache_dir || args->cache_stats) {
+    return "--cache";
+  }
+  // --parallel-lex and --parallel-parse imply --pretokenize
+  if (args->parallel_lex) {
+    return "--parallel-lex";
+  }
+  if (args->parallel_parse) {
+    return "--parallel-parse";
+  }
+  if (args->parallel_codegen) {
+    return "--parallel-codegen";
+  }
+  if (args->pretokenize) {
+    return "--pretokenize";
+  }
+  return NULL;
+}
+
+void SmlArgs_Free(SmlArgs *args) {
+  for (size_t i = 0; i < args->response_count; ++i) {
+    free(args->responses[i]);
+  }
+  free(args->responses);
+  free(args->source_files);
+  memset(args, 0, sizeof(SmlArgs));
+}
+
+// One option, or a source file; options taking a value advance *index
+static int parse_arg(SmlArgs *args, int argc, char **argv, int *index,
+                     Diagnostics *diag, bool *show_usage) {
+  int i = *index;
+  if (strcmp(argv[i], "--pretokenize") == 0) {
+    args->pretokenize = true;
+  } else if (strcmp(argv[i], "--parallel-lex") == 0) {
+    args->pretokenize = true;
+    args->parallel_lex = true;
+  } else if (strcmp(argv[i], "--parallel-parse") == 0) {
+    args->pretokenize = true;
+    args->parallel_parse = true;
+  } else if (strcmp(argv[i], "--parallel-codegen") == 0) {
+    args->parallel_codegen = true;
+  } else if (strcmp(argv[i], "--tiered") == 0) {
+    args->tiered = true;
+  } else if (strncmp(argv[i], "--hot-calls=", 12) == 0) {
+    char *end;
+    unsigned long calls = strtoul(argv[i] + 12, &end, 10);
+    if (argv[i][12] == 0 || *end != 0 || calls > UINT32_MAX) {
+      Diagnostics_Error(diag, "Invalid call count %s", argv[i] + 12);
+      return 1;
+    }
+    args->tiered = true;
+    args->hot_calls = calls;
+  } else if (strncmp(argv[i], "-O", 2) == 0) {
+    // bare -O means -O2, like cc
+    char *level = argv[i] + 2;
+    if (*level == 0) {
+      args->opt_level = 2;
+    } else if (level[0] >= '0' && level[0] <= '0' + SML_OPT_LEVEL_MAX &&
+               level[1] == 0) {
+      args->opt_level = level[0] - '0';
+    } else {
+      Diagnostics_Error(diag, "Invalid optimization level %s", argv[i]);
+      return 1;
+    }
+  } else if (strncmp(argv[i], "--passes=", 9) == 0) {
+    args->passes = argv[i] + 9;
+  } else if (strncmp(argv[i], "-march=", 7) == 0) {
+    // -march picks the CPU like on x86 cc, -march=native included
+    args->cpu = argv[i] + 7;
+  } else if (strncmp(argv[i], "-mcpu=", 6) == 0) {
+    args->cpu = argv[i] + 6;
+  } else if (strncmp(argv[i], "-mattr=", 7) == 0) {
+    args->features = argv[i] + 7;
+  } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+    if (Backend_EmitKindFromName(argv[i] + 7, &args->emit) != 0) {
+      Diagnostics_Error(diag, "Unknown output kind %s", argv[i] + 7);
+      *show_usage = true;
+      return 1;
+    }
+  } else if (strcmp(argv[i], "-o") == 0) {
+    if (++i == argc) {
+      Diagnostics_Error(diag, "Missing file name after -o");
+      return 1;
+    }
+    args->output_file = argv[i];
+    *index = i;
+  } else if (strcmp(argv[i], "--cache") == 0) {
+    // resolved to the default directory by whoever opens the cache
+    args->cache_dir = args->cache_dir ? args->cache_dir : "";
+  } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+    args->cache_dir = argv[i] + 12;
+  } else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+    char *end;
+    unsigned long megabytes = strtoul(argv[i] + 13, &end, 10);
+    if (argv[i][13] == 0 || *end != 0) {
+      Diagnostics_Error(diag, "Invalid cache size %s", argv[i] + 13);
+      return 1;
+    }
+    args->cache_size_mb = megabytes;
+  } else if (strcmp(argv[i], "--cache-stats") == 0) {
+    args->cache_stats = true;
+  } else if (strcmp(argv[i], "--server") == 0) {
+    args->server = true;
+  } else if (strcmp(argv[i], "--client") == 0) {
+    args->client = true;
+  } else if (strncmp(argv[i], "--socket=", 9) == 0) {
+    args->socket_path = argv[i] + 9;
+  } else if (strcmp(argv[i], "--time-report") == 0) {
+    args->time_report = true;
+  } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+    args->trace_file = argv[i] + 8;
+  } else if (strcmp(argv[i], "--mem-report") == 0) {
+    args->mem_report = true;
+  } else if (argv[i][0] == '-' && argv[i][1] != 0) {
+    Diagnostics_Error(diag, "Unknown option %s", argv[i]);
+    *show_usage = true;
+    return 1;
+  } else {
+    add_source(args, argv[i]);
+  }
+  return 0;
+}
+
+// Arguments are split on whitespace, there is no quoting, and a response
+// file can't name another one
+static int parse_response(SmlArgs *args, const char *path, Diagnostics *diag,
+                          bool *show_usage) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    Diagnostics_Error(diag, "Couldn't open response file %s: %s", path,
+                      strerror(errno));
+    return 1;
+  }
+  char *text = NULL;
+  size_t len = 0, capacity = 0;
+  for (;;) {
+    if (len + 4096 + 1 > capacity) {
+      capacity = capacity ? capacity * 2 : 8192;
+      text = realloc(text, capacity);
+      if (!text) {
+        perror("Unable to allocate memory");
+        exit(1);
+      }
+    }
+    size_t read = fread(text + len, 1, 4096, file);
+    len += read;
+    if (read == 0) {
+      break;
+    }
+  }
+  fclose(file);
+  text[len] = 0;
+
+  args->responses =
+      realloc(args->responses, sizeof(char *) * (args->response_count + 1));
+  if (!args->responses) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  args->responses[args->response_count++] = text;
+
+  // split in place
+  char **argv = NULL;
+  int argc = 0;
+  for (char *c = text; *c;) {
+    while (isspace((unsigned char)*c)) {
+      *c++ = 0;
+    }
+    if (!*c) {
+      break;
+    }
+    argv = realloc(argv, sizeof(char *) * (argc + 1));
+    if (!argv) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+    argv[argc++] = c;
+    while (*c && !isspace((unsigned char)*c)) {
+      c++;
+    }
+  }
+
+  int status = 0;
+  for (int i = 0; i < argc && status == 0; ++i) {
+    if (argv[i][0] == '@') {
+      Diagnostics_Error(diag, "Nested response file %s in %s", argv[i], path);
+      status = 1;
+    } else {
+      status = parse_arg(args, argc, argv, &i, diag, show_usage);
+    }
+  }
+  free(argv);
+  return status;
+}
+
+static void add_source(SmlArgs *args, char *path) {
+  args->source_files = realloc(args->source_files,
+                               sizeof(char *) * (args->source_count + 1));
+  if (!args->source_files) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  args->source_files[args->source_count++] = path;
+}
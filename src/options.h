@@ -0,0 +1,60 @@
+#ifndef SML_OPTIONS
+#define SML_OPTIONS
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "backend.h"
+#include "diag.h"
+
+// Command line of sml, shared with the compile server which receives the
+// client's arguments
+typedef struct SmlArgs {
+  bool run; // `sml run`
+  char **source_files; // more than one compiles them as a batch
+  size_t source_count;
+  char *output_file;
+  EmitKind emit;
+  bool pretokenize;
+  bool parallel_lex;
+  bool parallel_parse;
+  bool parallel_codegen;
+  int opt_level;
+  const char *passes;
+  const char *cpu;
+  const char *features;
+  bool tiered;
+  uint32_t hot_calls;
+
+  // --cache-dir=DIR, "" for --cache in the default directory, NULL for none
+  const char *cache_dir;
+  size_t cache_size_mb;  // --cache-size=MB
+  bool cache_stats;      // --cache-stats
+
+  bool server;             // --server: serve compile requests
+  bool client;             // --client: forward to a server if one is up
+  const char *socket_path; // --socket=PATH, NULL for the default
+
+  bool time_report;       // --time-report: phase times on stderr
+  const char *trace_file; // --trace=FILE: Chrome trace of the phases
+  bool mem_report;        // --mem-report: memory per phase on stderr
+
+  // contents of the response files, source_files may point into them
+  char **responses;
+  size_t response_count;
+} SmlArgs;
+
+// argv without the program name, the strings must outlive args. An @FILE
+// argument stands for the whitespace-separated arguments in FILE. Non-zero
+// after reporting why to diag; *show_usage is set when the usage should be
+// printed along. Free args either way.
+int SmlArgs_Parse(SmlArgs *args, int argc, char **argv, Diagnostics *diag,
+                  bool *show_usage);
+// The first option in args that only a compile in this process honors
+// (reports, the cache, the parallel front end), NULL if the compile server
+// can run args as they are
+const char *SmlArgs_LocalOnly(const SmlArgs *args);
+void SmlArgs_Free(SmlArgs *args);
+
+#endif
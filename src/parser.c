@@ -1,87 +1,315 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "ast.h"
+#include "diag.h"
 #include "lexer.h"
+#include "mem.h"
 #include "parser.h"
 #include "token.h"
 
+typedef struct ParseTask {
+  Parser parser;
+  Arena arena;
+  Diagnostics diag;
+  bool failed;
+  size_t first_token;
+  size_t stmt_count; // SIZE_MAX: everything up to EOF
+} ParseTask;
+
 typedef enum Precedence {
   PRECEDENCE_LOWEST = 1,
   PRECEDENCE_ADDITIVE = 2,
   PRECEDENCE_CALL = 3,
 } Precedence;
 
+typedef enum ExprFrameType {
+  FRAME_BINOP = 1, // waiting for the right-hand side
+  FRAME_CALL,      // collecting arguments
+} ExprFrameType;
+
+typedef struct ExprFrame {
+  ExprFrameType type;
+  Precedence outer; // precedence to resume with once reduced
+  ExprId lhs;
+  BinOperator op;
+  char *name;
+  size_t args_base; // into Parser.scratch
+} ExprFrame;
+
+static inline TokenType curr_type(const Parser *p);
+static inline TokenSpan curr_span(const Parser *p);
+static inline void start(Parser *p);
 static inline void bump(Parser *p);
 static inline void bump_expexted(Parser *p, TokenType);
-Stmt parse_stmt(Parser *);
-StmtFnDecl parse_stmt_fndecl(Parser *);
-StmtVarDecl parse_stmt_vardecl(Parser *);
-StmtReturn parse_stmt_return(Parser *);
+static inline char *take_token_string(Parser *p);
+static void parse_error(Parser *p, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3), noreturn));
+static void parser_release(Parser *p);
+static void scratch_push(Parser *, uint32_t);
+static void frame_push(Parser *, ExprFrame);
+static StmtBlock scratch_pop_block(Parser *, size_t base);
+static size_t skip_top_level_stmt(const TokenBuffer *, size_t);
+static void parse_task(void *);
+StmtId parse_stmt(Parser *);
+StmtId parse_stmt_fndecl(Parser *);
+StmtId parse_stmt_vardecl(Parser *);
+StmtId parse_stmt_return(Parser *);
 StmtBlock parse_stmt_block(Parser *);
-StmtExpr parse_expr(Parser *, Precedence);
-ExprCall parse_expr_call(Parser *, StmtExpr);
-ExprCallArgs parse_expr_call_args(Parser *);
-ExprBinOp parse_expr_binop(Parser *, StmtExpr);
+ExprId parse_expr(Parser *, Precedence);
+ExprId parse_expr_primary(Parser *);
+ExprId parse_expr_call_close(Parser *, const ExprFrame *);
+BinOperator parse_binop_operator(Parser *);
 Precedence token_to_precedence(TokenType);
 
-Parser Parser_New(Lexer lexer) {
+Parser Parser_New(Lexer lexer, Arena *arena, Diagnostics *diag) {
   Parser parser;
   parser.lexer = lexer;
+  parser.arena = arena;
+  parser.ast = AST_New();
+  parser.diag = diag;
+  parser.bail = NULL;
+  parser.scratch = NULL;
+  parser.scratch_count = 0;
+  parser.scratch_capacity = 0;
+  parser.frames = NULL;
+  parser.frame_count = 0;
+  parser.frame_capacity = 0;
+  parser.tokens = NULL;
+  parser.cursor = 0;
+  parser.token_count = 0;
   return parser;
 }
 
-AST Parse(Parser *p) {
-  bump(p);
-  bump(p);
+Parser Parser_NewFromTokens(Lexer lexer, const TokenBuffer *tokens,
+                            Arena *arena, Diagnostics *diag) {
+  Parser parser = Parser_New(lexer, arena, diag);
+  parser.tokens = tokens;
+  return parser;
+}
+
+int Parse(Parser *p, AST *ast) {
+  jmp_buf bail;
+  p->bail = &bail;
+  if (setjmp(bail) != 0) {
+    parser_release(p);
+    AST_Free(&p->ast);
+    return 1;
+  }
 
-  AST block;
-  block.stmt_count = 0;
-  block.capacity = SML_BLOCK_STMT_CAP;
-  block.stmts = malloc(sizeof(Stmt) * SML_BLOCK_STMT_CAP);
+  start(p);
 
-  while (p->curr_token.type != TOKEN_EOF) {
-    Stmt stmt = parse_stmt(p);
-    block.stmts[block.stmt_count++] = stmt;
+  size_t base = p->scratch_count;
+  while (curr_type(p) != TOKEN_EOF) {
+    scratch_push(p, parse_stmt(p));
   }
+  p->ast.root = scratch_pop_block(p, base);
 
-  return block;
+  parser_release(p);
+  *ast = p->ast;
+  return 0;
 }
 
-Stmt parse_stmt(Parser *p) {
-  switch (p->curr_token.type) {
-  case TOKEN_FN_DECL: {
-    Stmt stmt = {.type = STMT_FN_DECL, .value.fn_decl = parse_stmt_fndecl(p)};
-    return stmt;
+/*
+ * Parse a pre-tokenized file with its top-level statements spread over the
+ * pool. A pre-pass over the token types finds where each top-level statement
+ * ends (matching braces back to depth 0 for functions, the first ';' for
+ * everything else); consecutive statements are batched into tasks, each task
+ * parses into its own AST and arena, and the results are appended in source
+ * order. Whatever the pre-pass can't delimit is left to a final task that
+ * parses up to EOF, so malformed input still gets the sequential parser's
+ * diagnostics.
+ */
+int Parse_Parallel(Parser *p, ThreadPool *pool, AST *ast) {
+  const TokenBuffer *tokens = p->tokens;
+  if (!tokens) {
+    return Parse(p, ast);
   }
-  case TOKEN_LET: {
-    Stmt stmt = {.type = STMT_VAR_DECL,
-                 .value.var_decl = parse_stmt_vardecl(p)};
-    return stmt;
+
+  ParseTask *tasks = NULL;
+  size_t task_count = 0;
+  size_t task_capacity = 0;
+
+  size_t i = p->cursor;
+  size_t task_start = i;
+  size_t stmt_count = 0;
+  bool open_ended = false;
+
+  while (tokens->types[i] != TOKEN_EOF) {
+    size_t end = skip_top_level_stmt(tokens, i);
+    if (!end) {
+      open_ended = true;
+    }
+    if (open_ended || end - task_start >= SML_PARSE_TASK_TOKENS) {
+      if (task_count == task_capacity) {
+        task_capacity = task_capacity ? task_capacity * 2 : 16;
+        tasks = Mem_Realloc(tasks, sizeof(ParseTask) * task_capacity);
+      }
+      tasks[task_count].first_token = task_start;
+      tasks[task_count].stmt_count = open_ended ? SIZE_MAX : stmt_count + 1;
+      task_count++;
+      task_start = end;
+      stmt_count = 0;
+    } else {
+      stmt_count++;
+    }
+    if (open_ended) {
+      break;
+    }
+    i = end;
   }
-  case TOKEN_RETURN: {
-    Stmt stmt = {.type = STMT_RETURN, .value.return_ = parse_stmt_return(p)};
-    return stmt;
+  if (stmt_count > 0) {
+    if (task_count == task_capacity) {
+      tasks = Mem_Realloc(tasks, sizeof(ParseTask) * (task_capacity + 1));
+    }
+    tasks[task_count].first_token = task_start;
+    tasks[task_count].stmt_count = stmt_count;
+    task_count++;
   }
+
+  if (task_count <= 1) {
+    Mem_Free(tasks);
+    return Parse(p, ast);
+  }
+
+  for (size_t t = 0; t < task_count; ++t) {
+    tasks[t].parser = *p;
+    ThreadPool_Submit(pool, parse_task, &tasks[t]);
+  }
+  ThreadPool_Wait(pool);
+
+  // only the first error is reported, as the sequential parser would
+  bool failed = false;
+  size_t base = p->scratch_count;
+  for (size_t t = 0; t < task_count; ++t) {
+    AST *task_ast = &tasks[t].parser.ast;
+    if (!failed && tasks[t].failed) {
+      Diagnostics_Append(p->diag, &tasks[t].diag);
+      failed = true;
+    }
+    if (!failed) {
+      StmtBlock root = AST_Append(&p->ast, task_ast);
+      for (uint32_t s = 0; s < root.stmt_count; ++s) {
+        scratch_push(p, AST_BlockStmt(&p->ast, root, s));
+      }
+    }
+    AST_Free(task_ast);
+    Diagnostics_Free(&tasks[t].diag);
+    Arena_Adopt(p->arena, &tasks[t].arena);
+  }
+  Mem_Free(tasks);
+
+  if (failed) {
+    parser_release(p);
+    AST_Free(&p->ast);
+    return 1;
+  }
+  p->ast.root = scratch_pop_block(p, base);
+  parser_release(p);
+  *ast = p->ast;
+  return 0;
+}
+
+// One past the last token of the top-level statement starting at i, or 0 if
+// it doesn't close before EOF
+static size_t skip_top_level_stmt(const TokenBuffer *tokens, size_t i) {
+  const uint8_t *types = tokens->types;
+
+  if (types[i] == TOKEN_FN_DECL) {
+    size_t depth = 0;
+    for (; types[i] != TOKEN_EOF; ++i) {
+      if (types[i] == TOKEN_LBRACE) {
+        depth++;
+      } else if (types[i] == TOKEN_RBRACE) {
+        if (depth == 0) {
+          return 0;
+        }
+        if (--depth == 0) {
+          return i + 1;
+        }
+      }
+    }
+    return 0;
+  }
+
+  for (; types[i] != TOKEN_EOF; ++i) {
+    if (types[i] == TOKEN_SEMICOLON) {
+      return i + 1;
+    }
+    if (types[i] == TOKEN_LBRACE || types[i] == TOKEN_RBRACE) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+static void parse_task(void *arg) {
+  ParseTask *task = arg;
+  Parser *p = &task->parser;
+
+  task->arena = Arena_New();
+  task->diag = Diagnostics_New(NULL);
+  task->failed = false;
+  p->arena = &task->arena;
+  p->diag = &task->diag;
+  p->ast = AST_New();
+  p->scratch = NULL;
+  p->scratch_count = 0;
+  p->scratch_capacity = 0;
+  p->frames = NULL;
+  p->frame_count = 0;
+  p->frame_capacity = 0;
+  p->cursor = task->first_token;
+
+  jmp_buf bail;
+  p->bail = &bail;
+  if (setjmp(bail) != 0) {
+    task->failed = true;
+    parser_release(p);
+    return;
+  }
+
+  start(p);
+
+  for (size_t i = 0; i < task->stmt_count; ++i) {
+    if (curr_type(p) == TOKEN_EOF) {
+      break;
+    }
+    scratch_push(p, parse_stmt(p));
+  }
+  p->ast.root = scratch_pop_block(p, 0);
+  parser_release(p);
+}
+
+StmtId parse_stmt(Parser *p) {
+  switch (curr_type(p)) {
+  case TOKEN_FN_DECL:
+    return parse_stmt_fndecl(p);
+  case TOKEN_LET:
+    return parse_stmt_vardecl(p);
+  case TOKEN_RETURN:
+    return parse_stmt_return(p);
   default: {
-    Stmt stmt = {.type = STMT_EXPR,
-                 .value.expr = parse_expr(p, PRECEDENCE_LOWEST)};
+    StmtId stmt = AST_AddExprStmt(&p->ast, parse_expr(p, PRECEDENCE_LOWEST));
     bump_expexted(p, TOKEN_SEMICOLON);
     return stmt;
   }
   }
 }
 
-StmtFnDecl parse_stmt_fndecl(Parser *p) {
+StmtId parse_stmt_fndecl(Parser *p) {
   bump(p);
-  if (p->curr_token.type != TOKEN_IDENT) {
-    puts("Expected idenifier after 'function' but got: ");
-    Token_Inspect(&p->curr_token);
-    exit(1);
+  if (curr_type(p) != TOKEN_IDENT) {
+    parse_error(p, "Expected an identifier after 'function'");
   }
 
-  char *fn_name = p->curr_token.value.string;
+  char *fn_name = take_token_string(p);
   bump(p);
 
   bump_expexted(p, TOKEN_LPAREN);
@@ -90,195 +318,328 @@ StmtFnDecl parse_stmt_fndecl(Parser *p) {
   bump_expexted(p, TOKEN_ARROW);
 
   Type return_type;
-  switch (p->curr_token.type) {
+  switch (curr_type(p)) {
   case TOKEN_TYPE_INT:
     return_type = TYPE_INT;
     break;
   default:
-    puts("Expected type but got: ");
-    Token_Inspect(&p->curr_token);
-    exit(1);
+    parse_error(p, "Expected a type");
   }
   bump(p);
 
   StmtFnDecl fn = {
       .name = fn_name, .body = parse_stmt_block(p), .return_type = return_type};
-  return fn;
+  return AST_AddFnDecl(&p->ast, fn);
 }
 
 StmtBlock parse_stmt_block(Parser *p) {
-  StmtBlock block;
-  block.stmt_count = 0;
-  block.capacity = SML_BLOCK_STMT_CAP;
-  block.stmts = malloc(sizeof(Stmt) * SML_BLOCK_STMT_CAP);
-
   bump_expexted(p, TOKEN_LBRACE);
 
-  while (p->curr_token.type != TOKEN_EOF &&
-         p->curr_token.type != TOKEN_RBRACE) {
-    Stmt stmt = parse_stmt(p);
-    block.stmts[block.stmt_count++] = stmt;
+  size_t base = p->scratch_count;
+  while (curr_type(p) != TOKEN_EOF &&
+         curr_type(p) != TOKEN_RBRACE) {
+    scratch_push(p, parse_stmt(p));
   }
+  StmtBlock block = scratch_pop_block(p, base);
 
   bump_expexted(p, TOKEN_RBRACE);
 
   return block;
 }
 
-StmtReturn parse_stmt_return(Parser *p) {
+StmtId parse_stmt_return(Parser *p) {
   bump(p); // eat 'return'
 
   StmtReturn stmt_ret;
   stmt_ret.operand = parse_expr(p, PRECEDENCE_LOWEST);
   bump_expexted(p, TOKEN_SEMICOLON);
 
-  return stmt_ret;
+  return AST_AddReturn(&p->ast, stmt_ret);
 }
 
-StmtVarDecl parse_stmt_vardecl(Parser *p) {
+StmtId parse_stmt_vardecl(Parser *p) {
   bump(p);
 
-  if (p->curr_token.type != TOKEN_IDENT) {
-    fprintf(stderr, "'let' must follow an idenifier\n");
-    exit(1);
+  if (curr_type(p) != TOKEN_IDENT) {
+    parse_error(p, "Expected an identifier after 'let'");
   }
 
   StmtVarDecl var_decl;
   // variable type is unknown yet and will be determined at analysis step
   var_decl.type = 0;
-  var_decl.name = p->curr_token.value.string;
+  var_decl.name = take_token_string(p);
   bump(p);
 
-  if (p->curr_token.type != TOKEN_EQUAL) {
-    fprintf(stderr, "Missing init val for %s\n", var_decl.name);
+  if (curr_type(p) != TOKEN_EQUAL) {
+    parse_error(p, "Missing init val for %s", var_decl.name);
   }
 
   bump(p);
 
-  var_decl.init = malloc(sizeof(StmtExpr));
-  StmtExpr init = parse_expr(p, PRECEDENCE_LOWEST);
-  memmove(var_decl.init, &init, sizeof(StmtExpr));
+  var_decl.init = parse_expr(p, PRECEDENCE_LOWEST);
 
   bump_expexted(p, TOKEN_SEMICOLON);
 
-  return var_decl;
+  return AST_AddVarDecl(&p->ast, var_decl);
 }
 
-StmtExpr parse_expr(Parser *p, Precedence precedence) {
-  StmtExpr lhs;
-  switch (p->curr_token.type) {
-  case TOKEN_IDENT:
-    lhs.type = EXPR_IDENT;
-    lhs.value.ident.label = p->curr_token.value.string;
-    break;
-  case TOKEN_STRING:
-    lhs.type = EXPR_LITERAL;
-    lhs.value.literal.type = EXPR_LITERAL_STR;
-    lhs.value.literal.value.string = p->curr_token.value.string;
-    break;
-  case TOKEN_NUMBER:
-    lhs.type = EXPR_LITERAL;
-    lhs.value.literal.type = EXPR_LITERAL_NUM;
-    lhs.value.literal.value.number = p->curr_token.value.number;
-    break;
-  default:
-    puts("parse_expr: Unexpected token: ");
-    Token_Inspect(&p->curr_token);
-    exit(1);
-  }
-  bump(p);
+/*
+ * Operator-precedence parsing with an explicit frame stack instead of
+ * recursion, so nesting depth is bounded by memory rather than the machine
+ * stack. A frame is pushed for every operator or call whose operand is still
+ * being parsed and reduced once that operand is complete. Nodes are created
+ * in the same order a recursive descent parser would create them.
+ */
+ExprId parse_expr(Parser *p, Precedence precedence) {
+  size_t base = p->frame_count;
+  ExprId lhs;
+
+operand:
+  lhs = parse_expr_primary(p);
+
+  for (;;) {
+    TokenType tt = curr_type(p);
+
+    if (tt != TOKEN_EOF && precedence < token_to_precedence(tt)) {
+      if (tt == TOKEN_PLUS) {
+        ExprFrame frame = {.type = FRAME_BINOP, .outer = precedence};
+        frame.lhs = lhs;
+        frame.op = parse_binop_operator(p);
+        frame_push(p, frame);
+        precedence = token_to_precedence(tt);
+        goto operand;
+      }
+
+      if (tt == TOKEN_LPAREN) {
+        const ExprNode *callee = &p->ast.exprs.items[lhs];
+        if (callee->type != EXPR_IDENT) {
+          parse_error(p, "Invalid call expr");
+        }
+        ExprFrame frame = {.type = FRAME_CALL,
+                           .outer = precedence,
+                           .name = p->ast.idents.items[callee->index].label,
+                           .args_base = p->scratch_count};
+        frame_push(p, frame);
+        bump_expexted(p, TOKEN_LPAREN);
+        precedence = PRECEDENCE_CALL;
+        if (curr_type(p) != TOKEN_EOF &&
+            curr_type(p) != TOKEN_RPAREN) {
+          goto operand;
+        }
+        lhs = parse_expr_call_close(p, &p->frames[--p->frame_count]);
+        precedence = frame.outer;
+        continue;
+      }
+    }
 
-  while (p->curr_token.type != TOKEN_EOF &&
-         precedence < token_to_precedence(p->curr_token.type)) {
-    switch (p->curr_token.type) {
-    case TOKEN_LPAREN: {
-      StmtExpr expr = {.type = EXPR_CALL,
-                       .value.call = parse_expr_call(p, lhs)};
-      lhs = expr;
-      break;
+    // lhs can't grow any further at this precedence, hand it to the frame
+    // waiting for it
+    if (p->frame_count == base) {
+      return lhs;
     }
-    case TOKEN_PLUS: {
-      StmtExpr expr = {.type = EXPR_BINOP,
-                       .value.binop = parse_expr_binop(p, lhs)};
-      lhs = expr;
-      break;
+    ExprFrame *frame = &p->frames[p->frame_count - 1];
+
+    if (frame->type == FRAME_BINOP) {
+      ExprBinOp binop = {.op = frame->op, .lhs = frame->lhs, .rhs = lhs};
+      lhs = AST_AddBinOp(&p->ast, binop);
+      precedence = frame->outer;
+      p->frame_count--;
+      continue;
     }
-    default:
-      return lhs;
+
+    // FRAME_CALL: lhs is the next argument
+    scratch_push(p, lhs);
+    if (curr_type(p) != TOKEN_EOF &&
+        curr_type(p) != TOKEN_RPAREN) {
+      goto operand;
     }
+    precedence = frame->outer;
+    lhs = parse_expr_call_close(p, &p->frames[--p->frame_count]);
   }
-
-  return lhs;
 }
 
-ExprCall parse_expr_call(Parser *p, StmtExpr lhs) {
-  if (lhs.type != EXPR_IDENT) {
-    puts("Invalid call expr");
-    exit(1);
+ExprId parse_expr_primary(Parser *p) {
+  ExprId expr;
+  switch (curr_type(p)) {
+  case TOKEN_IDENT: {
+    ExprIdent ident = {.label = take_token_string(p)};
+    expr = AST_AddIdent(&p->ast, ident);
+    break;
+  }
+  case TOKEN_STRING: {
+    ExprLiteral literal = {.type = EXPR_LITERAL_STR,
+                           .value.string = take_token_string(p)};
+    expr = AST_AddLiteral(&p->ast, literal);
+    break;
+  }
+  case TOKEN_NUMBER: {
+    // the one token value the parser reads
+    long long number = p->tokens ? p->tokens->values[p->cursor]
+                                 : p->curr_token.value.number;
+    ExprLiteral literal = {.type = EXPR_LITERAL_NUM, .value.number = number};
+    expr = AST_AddLiteral(&p->ast, literal);
+    break;
+  }
+  default:
+    parse_error(p, "Expected an expression");
   }
-  ExprCallArgs args = parse_expr_call_args(p);
-  ExprCall call = {.name = lhs.value.ident.label, .args = args};
-  return call;
+  bump(p);
+  return expr;
 }
 
-ExprCallArgs parse_expr_call_args(Parser *p) {
-  bump_expexted(p, TOKEN_LPAREN);
-
-  ExprCallArgs args;
-  args.argc = 0;
-  args.capacity = SML_CALL_ARGS_CAP;
-  args.argv = malloc(sizeof(StmtExpr) * SML_CALL_ARGS_CAP);
-
-  while (p->curr_token.type != TOKEN_EOF &&
-         p->curr_token.type != TOKEN_RPAREN) {
-    StmtExpr arg = parse_expr(p, PRECEDENCE_CALL);
-    memmove(args.argv + args.argc++, &arg, sizeof(StmtExpr));
-  }
+// The arguments of the call in frame are on the scratch stack
+ExprId parse_expr_call_close(Parser *p, const ExprFrame *frame) {
+  ExprCall call = {.name = frame->name};
+  call.argc = p->scratch_count - frame->args_base;
+  call.args_start =
+      AST_AddCallArgs(&p->ast, p->scratch + frame->args_base, call.argc);
+  p->scratch_count = frame->args_base;
 
   bump_expexted(p, TOKEN_RPAREN);
 
-  return args;
+  return AST_AddCall(&p->ast, call);
 }
 
-ExprBinOp parse_expr_binop(Parser *p, StmtExpr lhs) {
+BinOperator parse_binop_operator(Parser *p) {
   BinOperator op;
 
-  switch (p->curr_token.type) {
+  switch (curr_type(p)) {
   case TOKEN_PLUS:
     op = BINOP_PLUS;
     break;
   default:
-    fprintf(stderr, "Invalid binop\n");
-    exit(1);
+    parse_error(p, "Invalid binop");
   }
-  TokenType op_type = p->curr_token.type;
   bump(p);
 
-  ExprBinOp binop;
+  return op;
+}
 
-  binop.op = op;
-  binop.lhs = malloc(sizeof(ExprBinOp));
-  binop.rhs = malloc(sizeof(ExprBinOp));
+/*
+ * Pre-tokenized input is read in place: cursor is the current token and
+ * only the column a caller asks for is loaded, without copying the token
+ * out. The lexer's tokens go through curr_token and next_token instead.
+ */
+static inline TokenType curr_type(const Parser *p) {
+  return p->tokens ? (TokenType)p->tokens->types[p->cursor]
+                   : p->curr_token.type;
+}
 
-  memmove(binop.lhs, &lhs, sizeof(StmtExpr));
-  StmtExpr rhs = parse_expr(p, token_to_precedence(op_type));
-  memmove(binop.rhs, &rhs, sizeof(StmtExpr));
+static inline TokenSpan curr_span(const Parser *p) {
+  if (!p->tokens) {
+    return p->curr_token.span;
+  }
+  return (TokenSpan){.start = p->tokens->starts[p->cursor],
+                     .len = p->tokens->lens[p->cursor]};
+}
 
-  return binop;
+static inline void start(Parser *p) {
+  if (!p->tokens) {
+    bump(p);
+    bump(p);
+  }
 }
 
 static inline void bump(Parser *p) {
+  if (p->tokens) {
+    // stays on the trailing EOF once it is reached
+    if (p->cursor + 1 < p->tokens->count) {
+      p->cursor++;
+    }
+    return;
+  }
   p->curr_token = p->next_token;
   p->next_token = Lexer_NextToken(&p->lexer);
+  p->token_count++;
 }
 
 static inline void bump_expexted(Parser *p, TokenType expected) {
-  if (p->curr_token.type == expected) {
+  if (curr_type(p) == expected) {
     return bump(p);
   }
-  puts("bump_expexted: Unexpecte token: ");
-  Token_Inspect(&p->curr_token);
-  exit(1);
+  parse_error(p, "Expected %s", Token_TypeText(expected));
+}
+
+// Copy the current token's text out of the source buffer into the arena
+static inline char *take_token_string(Parser *p) {
+  TokenSpan span = curr_span(p);
+  return Arena_StrNDup(p->arena, p->lexer.buffer + span.start, span.len);
+}
+
+// Report what was expected against the current token, then unwind to Parse
+static void parse_error(Parser *p, const char *fmt, ...) {
+  char message[256];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+
+  // only built here, for the value of an illegal character
+  Token current =
+      p->tokens ? TokenBuffer_At(p->tokens, p->cursor) : p->curr_token;
+  Token *token = &current;
+  TokenPosition position = Lexer_Position(&p->lexer, token->span.start);
+  if (token->type == TOKEN_IDENT || token->type == TOKEN_NUMBER) {
+    Diagnostics_Error(p->diag, "%s but got '%.*s' at %zu:%zu", message,
+                      (int)token->span.len, p->lexer.buffer + token->span.start,
+                      position.line, position.colm);
+  } else if (token->type == TOKEN_ILLEGAL) {
+    Diagnostics_Error(p->diag, "%s but got '%c' at %zu:%zu", message,
+                      token->value.char_, position.line, position.colm);
+  } else {
+    Diagnostics_Error(p->diag, "%s but got %s at %zu:%zu", message,
+                      Token_TypeText(token->type), position.line,
+                      position.colm);
+  }
+  longjmp(*p->bail, 1);
+}
+
+static void parser_release(Parser *p) {
+  Mem_Free(p->scratch);
+  Mem_Free(p->frames);
+  p->scratch = NULL;
+  p->scratch_count = 0;
+  p->scratch_capacity = 0;
+  p->frames = NULL;
+  p->frame_count = 0;
+  p->frame_capacity = 0;
+  p->bail = NULL;
+}
+
+static void scratch_push(Parser *p, uint32_t id) {
+  if (p->scratch_count == p->scratch_capacity) {
+    p->scratch_capacity =
+        p->scratch_capacity ? p->scratch_capacity * 2 : SML_PARSE_SCRATCH_CAP;
+    p->scratch =
+        Mem_Realloc(p->scratch, sizeof(uint32_t) * p->scratch_capacity);
+    if (!p->scratch) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  p->scratch[p->scratch_count++] = id;
+}
+
+static void frame_push(Parser *p, ExprFrame frame) {
+  if (p->frame_count == p->frame_capacity) {
+    p->frame_capacity =
+        p->frame_capacity ? p->frame_capacity * 2 : SML_PARSE_FRAMES_CAP;
+    p->frames = Mem_Realloc(p->frames, sizeof(ExprFrame) * p->frame_capacity);
+    if (!p->frames) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  p->frames[p->frame_count] = frame;
+  p->frame_count++;
+}
+
+// Move the statement ids pushed since base into the AST as one block
+static StmtBlock scratch_pop_block(Parser *p, size_t base) {
+  StmtBlock block =
+      AST_AddBlock(&p->ast, p->scratch + base, p->scratch_count - base);
+  p->scratch_count = base;
+  return block;
 }
 
 Precedence token_to_precedence(TokenType tt) {
@@ -1,17 +1,58 @@
 #ifndef SML_PARSER
 #define SML_PARSER
 
+#include <setjmp.h>
+
+#include "arena.h"
 #include "ast.h"
+#include "diag.h"
 #include "lexer.h"
+#include "thread_pool.h"
 #include "token.h"
+#include "token_buffer.h"
+
+#define SML_PARSE_SCRATCH_CAP 64
+#define SML_PARSE_FRAMES_CAP 16
+
+// top-level statements are batched into parse tasks of about this many tokens
+#define SML_PARSE_TASK_TOKENS (16 * 1024)
 
 typedef struct {
   Lexer lexer;
   Token curr_token;
   Token next_token;
+  Arena *arena;
+  AST ast;
+
+  // the first syntax error is reported here and unwinds to Parse through
+  // bail; parsing stops there
+  Diagnostics *diag;
+  jmp_buf *bail;
+
+  // ids of the statements/arguments of every block or call being parsed,
+  // copied into the AST as one contiguous range once it is complete
+  uint32_t *scratch;
+  size_t scratch_count;
+  size_t scratch_capacity;
+
+  // operators and calls whose operands are still being parsed
+  struct ExprFrame *frames;
+  size_t frame_count;
+  size_t frame_capacity;
+
+  // pre-tokenized mode: tokens come from here instead of the lexer, cursor
+  // is the current token's index and curr_token/next_token go unused
+  const TokenBuffer *tokens;
+  size_t cursor;
+
+  size_t token_count; // read from the lexer, for --time-report
 } Parser;
 
-Parser Parser_New(Lexer lexer);
-AST Parse(Parser *);
+Parser Parser_New(Lexer lexer, Arena *arena, Diagnostics *diag);
+Parser Parser_NewFromTokens(Lexer lexer, const TokenBuffer *tokens,
+                            Arena *arena, Diagnostics *diag);
+// Non-zero on a syntax error, with nothing left to free in the parser
+int Parse(Parser *, AST *ast);
+int Parse_Parallel(Parser *, ThreadPool *, AST *ast);
 
 #endif
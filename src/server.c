@@ -0,0 +1,278 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <llvm-c/Core.h>
+
+#include "backend.h"
+#include "options.h"
+#include "server.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include "worker.h"
+
+static volatile sig_atomic_t server_stopping = 0;
+
+static void server_stop(int signal);
+static bool peer_allowed(int fd);
+static void serve_connection(void *arg);
+static int serve_compile(Diagnostics *reply, char *cwd, int argc,
+                         char **argv, char **written, size_t *written_len);
+static void append_line(char **text, size_t *len, const char *line);
+static char *resolve_path(const char *cwd, const char *path);
+
+int Server_Run(const char *socket_path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "[Error] Socket path too long: %s\n", socket_path);
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  // a socket left behind by a server that died is taken over
+  int probe = Server_Connect(socket_path);
+  if (probe >= 0) {
+    close(probe);
+    fprintf(stderr, "[Error] A server is already listening on %s\n",
+            socket_path);
+    return 1;
+  }
+  unlink(socket_path);
+
+  // requests name files to read and write as this user, the socket is
+  // created owner-only rather than with whatever the umask allows
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  mode_t umask_previous = umask(0177);
+  int bound =
+      listener >= 0 ? bind(listener, (struct sockaddr *)&addr, sizeof(addr))
+                    : -1;
+  umask(umask_previous);
+  if (bound != 0 || listen(listener, SOMAXCONN) != 0) {
+    fprintf(stderr, "[Error] Unable to listen on %s: %s\n", socket_path,
+            strerror(errno));
+    if (listener >= 0) {
+      close(listener);
+    }
+    return 1;
+  }
+
+  // accept must fail with EINTR to notice the signal, so no SA_RESTART
+  struct sigaction stop = {.sa_handler = server_stop};
+  sigemptyset(&stop.sa_mask);
+  sigaction(SIGINT, &stop, NULL);
+  sigaction(SIGTERM, &stop, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  // the workers inherit a mask without the stop signals, so they interrupt
+  // this thread's accept
+  sigset_t stop_signals, previous;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &previous);
+  ThreadPool *pool = ThreadPool_New(0);
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+  fprintf(stderr, "sml: serving on %s with %zu threads\n", socket_path,
+          pool->thread_count);
+  while (!server_stopping) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        fprintf(stderr, "[Error] accept: %s\n", strerror(errno));
+        break;
+      }
+      continue;
+    }
+    if (!peer_allowed(fd)) {
+      close(fd);
+      continue;
+    }
+    // a client that stalls mid-message gives its worker back
+    struct timeval timeout = {.tv_sec = SML_SERVER_TIMEOUT_S};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    ThreadPool_Submit(pool, serve_connection, (void *)(intptr_t)fd);
+  }
+
+  close(listener);
+  unlink(socket_path);
+  ThreadPool_Free(pool);
+  return 0;
+}
+
+static void server_stop(int signal) {
+  (void)signal;
+  server_stopping = 1;
+}
+
+// Only processes of the user running the server may use it
+static bool peer_allowed(int fd) {
+  struct ucred peer;
+  socklen_t len = sizeof(peer);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) != 0) {
+    fprintf(stderr, "[Error] Unable to identify a client: %s\n",
+            strerror(errno));
+    return false;
+  }
+  if (peer.uid != getuid()) {
+    fprintf(stderr, "[Error] Refused a client of uid %u\n",
+            (unsigned)peer.uid);
+    return false;
+  }
+  return true;
+}
+
+static void serve_connection(void *arg) {
+  int fd = (intptr_t)arg;
+  uint32_t len;
+  char *request = Server_RecvMessage(fd, &len);
+  if (!request) {
+    close(fd);
+    return;
+  }
+
+  // cwd first, then the arguments, every one NUL-terminated
+  char **argv = malloc(sizeof(char *) * (len + 1));
+  int argc = 0;
+  for (uint32_t i = 0; i < len; i += strlen(request + i) + 1) {
+    argv[argc++] = request + i;
+  }
+
+  Diagnostics reply = Diagnostics_New(NULL);
+  // the paths written, one per line
+  char *written = NULL;
+  size_t written_len = 0;
+  int32_t status;
+  if (argc == 0) {
+    Diagnostics_Error(&reply, "Empty request");
+    status = 1;
+  } else {
+    status = serve_compile(&reply, argv[0], argc - 1, argv + 1, &written,
+                           &written_len);
+  }
+
+  // a client that went away just doesn't get its answer
+  if (Server_SendAll(fd, &status, sizeof(status)) == 0 &&
+      Server_SendMessage(fd, reply.text ? reply.text : "", reply.len) == 0) {
+    Server_SendMessage(fd, written ? written : "", written_len);
+  }
+
+  close(fd);
+  Diagnostics_Free(&reply);
+  free(written);
+  free(argv);
+  free(request);
+}
+
+// Same as `sml [options] files...`, except that nothing is printed
+static int serve_compile(Diagnostics *reply, char *cwd, int argc,
+                         char **argv, char **written, size_t *written_len) {
+  // response files are the client's too
+  char *resolved[argc + 1];
+  for (int i = 0; i < argc; ++i) {
+    resolved[i] = NULL;
+    if (argv[i][0] == '@') {
+      char *path = resolve_path(cwd, argv[i] + 1);
+      resolved[i] = malloc(strlen(path) + 2);
+      if (!resolved[i]) {
+        perror("Unable to allocate memory");
+        exit(1);
+      }
+      sprintf(resolved[i], "@%s", path);
+      free(path);
+      argv[i] = resolved[i];
+    }
+  }
+
+  SmlArgs args;
+  bool show_usage;
+  int status = SmlArgs_Parse(&args, argc, argv, reply, &show_usage);
+  for (int i = 0; i < argc; ++i) {
+    free(resolved[i]);
+  }
+  if (status != 0) {
+    SmlArgs_Free(&args);
+    return 1;
+  }
+  if (args.run || args.server || args.source_count == 0 ||
+      (args.output_file && args.source_count > 1)) {
+    Diagnostics_Error(reply, "The server only compiles source files");
+    SmlArgs_Free(&args);
+    return 1;
+  }
+  // clients compile these themselves, only a response file gets them here
+  const char *local_only = SmlArgs_LocalOnly(&args);
+  if (local_only) {
+    Diagnostics_Error(reply, "The server doesn't take %s, compile without "
+                             "the server for it",
+                      local_only);
+    SmlArgs_Free(&args);
+    return 1;
+  }
+
+  CompileWorker *worker = CompileWorker_ForThread();
+  for (size_t i = 0; i < args.source_count; ++i) {
+    char *source_name = args.source_files[i];
+    if (strcmp(source_name, "-") == 0) {
+      Diagnostics_Error(reply, "The server can't read the client's stdin");
+      status = 1;
+      continue;
+    }
+    char *source_path = resolve_path(cwd, source_name);
+    char *output =
+        args.output_file
+            ? resolve_path(cwd, args.output_file)
+            : change_file_ext(source_path, Backend_EmitExtension(args.emit));
+    // named as the client spelled it, like a local compile
+    if (CompileWorker_CompileFile(worker, &args, source_path, source_name,
+                                  output) == 0) {
+      append_line(written, written_len, output);
+    } else {
+      status = 1;
+    }
+    Diagnostics_Append(reply, &worker->compiler.diag);
+    free(output);
+    free(source_path);
+  }
+  SmlArgs_Free(&args);
+  return status;
+}
+
+static char *resolve_path(const char *cwd, const char *path) {
+  size_t len = strlen(cwd) + strlen(path) + 2;
+  char *resolved = malloc(len);
+  if (!resolved) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  if (path[0] == '/') {
+    strcpy(resolved, path);
+  } else {
+    snprintf(resolved, len, "%s/%s", cwd, path);
+  }
+  return resolved;
+}
+
+static void append_line(char **text, size_t *len, const char *line) {
+  size_t line_len = strlen(line);
+  *text = realloc(*text, *len + line_len + 2);
+  if (!*text) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  memcpy(*text + *len, line, line_len);
+  *len += line_len;
+  (*text)[(*len)++] = '\n';
+  (*text)[*len] = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef SML_SERVER
+#define SML_SERVER
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest request accepted, the client's arguments and directory
+#define SML_SERVER_REQUEST_MAX (1024 * 1024)
+// Seconds a client may take to send its request or read a response part
+#define SML_SERVER_TIMEOUT_S 10
+
+/*
+ * `sml --server` keeps LLVM, the standard library and target machines warm
+ * and compiles on behalf of `sml --client`, which forwards its arguments and
+ * working directory over a Unix domain socket. Both ends are on the same
+ * host, so each message is a native uint32 length followed by that many
+ * bytes:
+ *
+ *   request:  cwd \0 arg \0 arg \0 ...
+ *   response: int32 exit status, then a message with the diagnostics and
+ *             one with the paths written, one per line
+ */
+
+// $XDG_RUNTIME_DIR/sml.sock, else /tmp/sml-<uid>.sock. Free the result.
+char *Server_DefaultSocket(void);
+
+// Serve connections on all cores until SIGINT or SIGTERM. Non-zero, after
+// reporting why, if the socket can't be bound.
+int Server_Run(const char *socket_path);
+
+// Have the server run `sml argv...` from this directory and print its
+// diagnostics to stderr. Returns the server's exit status, or -1 if no
+// server answered and the caller should compile on its own.
+int Server_Forward(const char *socket_path, int argc, char **argv);
+
+// Wire helpers shared by both ends, non-zero (NULL) on failure
+int Server_Connect(const char *socket_path); // the socket, -1 if no server
+int Server_SendAll(int fd, const void *data, size_t len);
+int Server_RecvAll(int fd, void *data, size_t len);
+int Server_SendMessage(int fd, const char *data, size_t len);
+// NUL-terminated for convenience, NULL on a short read or oversized message
+char *Server_RecvMessage(int fd, uint32_t *len);
+
+#endif
@@ -0,0 +1,151 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+
+// The client half and the wire format. Kept apart from the server so that
+// sml_client links without LLVM, whose loading costs more than a compile.
+
+char *Server_DefaultSocket(void) {
+  const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  char *path = malloc(sizeof(((struct sockaddr_un *)0)->sun_path));
+  if (!path) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  if (runtime_dir && *runtime_dir) {
+    snprintf(path, sizeof(((struct sockaddr_un *)0)->sun_path), "%s/sml.sock",
+             runtime_dir);
+  } else {
+    snprintf(path, sizeof(((struct sockaddr_un *)0)->sun_path),
+             "/tmp/sml-%u.sock", (unsigned)getuid());
+  }
+  return path;
+}
+
+int Server_Forward(const char *socket_path, int argc, char **argv) {
+  int fd = Server_Connect(socket_path);
+  if (fd < 0) {
+    return -1;
+  }
+
+  char *cwd = getcwd(NULL, 0);
+  size_t len = cwd ? strlen(cwd) + 1 : 0;
+  for (int i = 0; i < argc; ++i) {
+    len += strlen(argv[i]) + 1;
+  }
+  char *request = malloc(len + 1);
+  if (!cwd || !request) {
+    free(cwd);
+    free(request);
+    close(fd);
+    return -1;
+  }
+  char *out = request;
+  out = stpcpy(out, cwd) + 1;
+  for (int i = 0; i < argc; ++i) {
+    out = stpcpy(out, argv[i]) + 1;
+  }
+  free(cwd);
+
+  int32_t status;
+  int sent = Server_SendMessage(fd, request, len);
+  free(request);
+  // up to the status nothing happened yet, compiling locally is still fine
+  if (sent != 0 || Server_RecvAll(fd, &status, sizeof(status)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  uint32_t diag_len, written_len;
+  char *diagnostics = Server_RecvMessage(fd, &diag_len);
+  char *written = diagnostics ? Server_RecvMessage(fd, &written_len) : NULL;
+  close(fd);
+  if (!written) {
+    free(diagnostics);
+    fprintf(stderr, "[Error] The compile server hung up\n");
+    return 1;
+  }
+  fwrite(diagnostics, 1, diag_len, stderr);
+  free(diagnostics);
+  free(written);
+  return status;
+}
+
+int Server_Connect(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int Server_SendAll(int fd, const void *data, size_t len) {
+  const char *bytes = data;
+  while (len > 0) {
+    ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return 1;
+    }
+    bytes += sent;
+    len -= sent;
+  }
+  return 0;
+}
+
+int Server_RecvAll(int fd, void *data, size_t len) {
+  char *bytes = data;
+  while (len > 0) {
+    ssize_t received = recv(fd, bytes, len, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return 1;
+    }
+    bytes += received;
+    len -= received;
+  }
+  return 0;
+}
+
+int Server_SendMessage(int fd, const char *data, size_t len) {
+  uint32_t header = len;
+  return Server_SendAll(fd, &header, sizeof(header)) ||
+         Server_SendAll(fd, data, len);
+}
+
+char *Server_RecvMessage(int fd, uint32_t *len) {
+  if (Server_RecvAll(fd, len, sizeof(*len)) != 0 ||
+      *len > SML_SERVER_REQUEST_MAX) {
+    return NULL;
+  }
+  char *data = malloc(*len + 1);
+  if (!data) {
+    return NULL;
+  }
+  if (Server_RecvAll(fd, data, *len) != 0) {
+    free(data);
+    return NULL;
+  }
+  data[*len] = 0;
+  return data;
+}
@@ -1,4 +1,6 @@
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,59 +9,367 @@
 #include <llvm-c/Core.h>
 #include <llvm-c/Types.h>
 
+#include "arena.h"
 #include "ast.h"
+#include "backend.h"
+#include "batch.h"
+#include "cache.h"
+#include "compiler.h"
+#include "fold.h"
+#include "interp.h"
+#include "jit.h"
 #include "lexer.h"
 #include "llvm_gen.h"
+#include "mem.h"
+#include "options.h"
 #include "parser.h"
+#include "server.h"
+#include "source.h"
+#include "thread_pool.h"
+#include "timing.h"
+#include "token_buffer.h"
 #include "type_check.h"
 #include "utils.h"
 
 void print_usage();
-char *read_file(char *path);
+static int run_tiered(AST *ast, char *source_file, const SmlArgs *args,
+                      int *exit_code);
+static int run_compiled(AST *ast, char *source_file,
+                        const SmlArgs *args, int *exit_code);
+static int report_phases(const SmlArgs *args);
 
 int main(int argc, char *argv[]) {
-  if (argc <= 1) {
+  SmlArgs args;
+  bool show_usage;
+  // reported as they are found, the front end stops at the first error
+  Diagnostics diag = Diagnostics_New(stderr);
+  if (SmlArgs_Parse(&args, argc - 1, argv + 1, &diag, &show_usage) != 0) {
+    if (show_usage) {
+      print_usage();
+    }
+    return 1;
+  }
+  char *output_file = args.output_file;
+  EmitKind emit = args.emit;
+  int opt_level = args.opt_level;
+  const char *passes = args.passes;
+  const char *cpu = args.cpu;
+  const char *features = args.features;
+  if (args.time_report || args.trace_file) {
+    Timing_Enable();
+  }
+  if (args.mem_report) {
+    Mem_Enable();
+  }
+
+  if (args.server || args.client) {
+    char *socket_path = args.socket_path ? strdup(args.socket_path)
+                                         : Server_DefaultSocket();
+    int status = -1;
+    if (args.server) {
+      status = Server_Run(socket_path);
+    } else if (!args.run && args.source_count > 0 &&
+               !SmlArgs_LocalOnly(&args)) {
+      // the server can't run programs, read our stdin or report on its
+      // phases here
+      bool reads_stdin = false;
+      for (size_t i = 0; i < args.source_count; ++i) {
+        reads_stdin = reads_stdin || strcmp(args.source_files[i], "-") == 0;
+      }
+      if (!reads_stdin) {
+        status = Server_Forward(socket_path, argc - 1, argv + 1);
+      }
+    }
+    free(socket_path);
+    // without a server the client compiles on its own
+    if (status >= 0) {
+      return status;
+    }
+  }
+
+  if (args.source_count == 0) {
     fprintf(stderr, "[Error] Missing source file\n");
     print_usage();
     return 1;
   }
+  if (args.source_count > 1) {
+    // files already compile in parallel, one per core
+    if (args.run || output_file || args.cache_dir || args.pretokenize ||
+        args.parallel_codegen) {
+      fprintf(stderr, "[Error] run, -o, --cache, --pretokenize and "
+                      "--parallel-* take a single source file\n");
+      return 1;
+    }
+    int status = Batch_Compile(&args);
+    status |= report_phases(&args);
+    SmlArgs_Free(&args);
+    return status;
+  }
+  char *source_file = args.source_files[0];
+
+  TimingScope timing = Timing_Begin("read source", NULL);
+  SourceFile source;
+  if (SourceFile_Open(source_file, &source, &diag) != 0) {
+    return 1;
+  }
+  Timing_End(timing);
+
+  // owns the AST, released once codegen is done with it
+  Arena arena = Arena_New();
+  SmlCompiler compiler;
 
-  char *source_file = argv[1];
+  ThreadPool *pool =
+      (args.parallel_lex || args.parallel_parse) ? ThreadPool_New(0) : NULL;
 
-  Lexer lexer = Lexer_New(read_file(source_file));
-  Parser parser = Parser_New(lexer);
-  StmtBlock ast = Parse(&parser);
+  Lexer lexer = Lexer_New(source.data, source.len);
+  TokenBuffer tokens = TokenBuffer_New();
+  Parser parser;
+  if (args.pretokenize) {
+    timing = Timing_Begin("lex", NULL);
+    int status = args.parallel_lex
+                     ? TokenBuffer_LexParallel(&tokens, &lexer, pool)
+                     : TokenBuffer_Lex(&tokens, &lexer);
+    if (status != 0) {
+      return 1;
+    }
+    Timing_End(timing);
+    Timing_Count(TIMING_TOKENS, tokens.count);
+    parser = Parser_NewFromTokens(lexer, &tokens, &arena, &diag);
+  } else {
+    parser = Parser_New(lexer, &arena, &diag);
+  }
+  AST ast;
+  // without --pretokenize this includes lexing
+  timing = Timing_Begin("parse", NULL);
+  int parse_status = args.parallel_parse ? Parse_Parallel(&parser, pool, &ast)
+                                    : Parse(&parser, &ast);
+  Timing_End(timing);
+  Timing_Count(TIMING_TOKENS, parser.token_count);
+
+  if (pool) {
+    ThreadPool_Free(pool);
+  }
+  if (parse_status != 0) {
+    return 1;
+  }
+  Timing_Count(TIMING_AST_NODES, ast.exprs.count + ast.stmts.count);
 
+  timing = Timing_Begin("type check", NULL);
   AST_type_check(&ast);
+  Timing_End(timing);
+  timing = Timing_Begin("fold", NULL);
+  AST_fold(&ast);
+  Timing_End(timing);
 
-  AST_Inspect(ast);
-  LLVMModuleRef module = llvm_emit_module(ast, source_file);
-  LLVMPrintModuleToFile(module, change_file_ext(source_file, ".ll"), 0);
+  int exit_code = 0;
+  int run_status = 0;
+  if (args.run && args.tiered) {
+    run_status = run_tiered(&ast, source_file, &args, &exit_code);
+  } else if (args.run) {
+    run_status = run_compiled(&ast, source_file, &args, &exit_code);
+  } else {
+    timing = Timing_Begin("inspect", NULL);
+    AST_Inspect(&ast);
+    Timing_End(timing);
+    SmlCompiler_Init(&compiler, LLVMGetGlobalContext(), stderr);
+    LLVMTargetMachineRef machine =
+        Backend_NewTargetMachine(opt_level, cpu, features, &compiler.diag);
+    if (!machine) {
+      return 1;
+    }
+    LLVMModuleRef module;
+    if (args.cache_dir) {
+      // functions come back optimized, from the cache or freshly built
+      char *cache_dir = *args.cache_dir ? strdup(args.cache_dir)
+                                        : Cache_DefaultDir();
+      Cache cache;
+      int status = Cache_Open(&cache, cache_dir,
+                              args.cache_size_mb * 1024 * 1024);
+      free(cache_dir);
+      if (status != 0) {
+        return 1;
+      }
+      timing = Timing_Begin("cache", NULL);
+      module = llvm_emit_module_cached(&compiler, &ast, source_file, machine,
+                                       opt_level, passes, &cache);
+      Cache_Evict(&cache);
+      Timing_End(timing);
+      if (args.cache_stats) {
+        fprintf(stderr,
+                "sml: cache %zu hits, %zu misses, %zu bytes stored, %zu "
+                "evicted\n",
+                cache.stats.hits, cache.stats.misses, cache.stats.stored,
+                cache.stats.evicted);
+      }
+      Cache_Close(&cache);
+      if (!module) {
+        return 1;
+      }
+    } else if (args.parallel_codegen) {
+      // partitions come back optimized
+      ThreadPool *codegen_pool = ThreadPool_New(0);
+      module = llvm_emit_module_parallel(&compiler, &ast, source_file, cpu,
+                                         features, opt_level, passes,
+                                         codegen_pool);
+      ThreadPool_Free(codegen_pool);
+      if (!module) {
+        return 1;
+      }
+    } else {
+      module = llvm_emit_module(&compiler, &ast, source_file, machine);
+      if (!module) {
+        return 1;
+      }
+      Backend_SetTarget(module, machine);
+      if (Backend_Optimize(module, machine, opt_level, passes, &diag) != 0) {
+        return 1;
+      }
+    }
 
-  LLVMDisposeModule(module);
+    char *output = output_file ? output_file
+                               : change_file_ext(source_file,
+                                                 Backend_EmitExtension(emit));
+    if (Backend_Emit(module, machine, emit, output, &diag) != 0) {
+      return 1;
+    }
+    if (output != output_file) {
+      Mem_Free(output);
+    }
 
-  return 0;
-}
+    LLVMDisposeModule(module);
+    LLVMDisposeTargetMachine(machine);
+    SmlCompiler_Free(&compiler);
+  }
 
-void print_usage() {
-  printf("\nUsage:\n");
-  printf("\tsmlc source_file\n");
+  if (run_status != 0) {
+    exit_code = 1;
+  } else if (report_phases(&args) != 0 && exit_code == 0) {
+    exit_code = 1;
+  }
+
+  AST_Free(&ast);
+  Diagnostics_Free(&diag);
+  SmlArgs_Free(&args);
+  TokenBuffer_Free(&tokens);
+  Lexer_Free(&parser.lexer);
+  Arena_Free(&arena);
+  SourceFile_Close(&source);
+
+  return exit_code;
 }
 
-char *read_file(char *path) {
-  FILE *fp = fopen(path, "r");
-  if (!fp) {
-    fprintf(stderr, "[Error] Couldn't open file %s: %s\n", path,
-            strerror(errno));
+// Interprets main, compiling hot functions on the side, 0 or 1 on error
+static int run_tiered(AST *ast, char *source_file, const SmlArgs *args,
+                      int *exit_code) {
+  JIT jit;
+  if (args->hot_calls && JIT_New(&jit) != 0) {
+    return 1;
+  }
+  int status = 1;
+  Interp interp;
+  TimingScope timing = Timing_Begin("run", NULL);
+  if (Interp_New(&interp, ast, source_file, args->hot_calls ? &jit : NULL,
+                 args->hot_calls, args->opt_level, args->passes) == 0) {
+    status = Interp_RunMain(&interp, exit_code);
+    Interp_Free(&interp);
+  }
+  Timing_End(timing);
+  if (args->hot_calls) {
+    JIT_Free(&jit);
   }
+  return status;
+}
 
-  fseek(fp, 0, SEEK_END);
-  size_t file_size = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
+// Compiles the whole program in memory and runs main, 0 or 1 on error
+static int run_compiled(AST *ast, char *source_file,
+                        const SmlArgs *args, int *exit_code) {
+  JIT jit;
+  if (JIT_New(&jit) != 0) {
+    return 1;
+  }
+  SmlCompiler compiler;
+  SmlCompiler_Init(&compiler, JIT_Context(&jit), stderr);
+  int status = 1;
+  LLVMModuleRef module = llvm_emit_module(&compiler, ast, source_file, NULL);
+  if (module) {
+    JIT_SetTarget(&jit, module);
+    if (Backend_Optimize(module, NULL, args->opt_level, args->passes,
+                         &compiler.diag) != 0) {
+      LLVMDisposeModule(module);
+    } else {
+      // JIT compilation happens on the first lookup, inside this scope
+      TimingScope timing = Timing_Begin("run", NULL);
+      // the JIT owns the module from here on
+      status = JIT_RunMain(&jit, module, exit_code);
+      Timing_End(timing);
+    }
+  }
+  SmlCompiler_Free(&compiler);
+  JIT_Free(&jit);
+  return status;
+}
 
-  char *contents = malloc(sizeof(char) * (file_size + 1));
-  fread(contents, sizeof(char), file_size, fp);
-  contents[file_size] = '\00';
+static int report_phases(const SmlArgs *args) {
+  if (args->time_report) {
+    Timing_Report(stderr);
+  }
+  if (args->mem_report) {
+    Mem_Report(stderr);
+  }
+  if (args->trace_file) {
+    return Timing_WriteTrace(args->trace_file);
+  }
+  return 0;
+}
 
-  return contents;
+void print_usage() {
+  printf("\nUsage:\n");
+  printf("\tsmlc [options] source_file\n");
+  printf("\tsmlc [options] files... @list  (compile all of them on all "
+         "cores;\n\t                a list file holds more arguments)\n");
+  printf("\tsmlc [options] -            (read the source from stdin)\n");
+  printf("\tsmlc run [options] source_file\n");
+  printf("\t                (compile in memory, run main and exit with its "
+         "result)\n");
+  printf("\nOptions:\n");
+  printf("\t--tiered        run: interpret right away, compile hot functions "
+         "in\n\t                the background\n");
+  printf("\t--hot-calls=N   run: calls before a function is compiled, "
+         "implies\n\t                --tiered (default %d, 0 never "
+         "compiles)\n",
+         SML_HOT_CALLS);
+  printf("\t--server        keep compiling for clients, on --socket or "
+         "the\n\t                default $XDG_RUNTIME_DIR/sml.sock\n");
+  printf("\t--client        have a running --server compile, else compile "
+         "here\n");
+  printf("\t--socket=PATH   socket of --server and --client\n");
+  printf("\t--pretokenize   lex the whole file before parsing\n");
+  printf("\t--parallel-lex  pre-tokenize large files on all cores\n");
+  printf("\t--parallel-parse parse top-level declarations on all cores\n");
+  printf("\t--parallel-codegen\n");
+  printf("\t                emit and optimize functions on all cores, then "
+         "link\n");
+  printf("\t--cache         reuse functions whose code can't have changed, "
+         "kept\n\t                in $XDG_CACHE_HOME/sml or ~/.cache/sml\n");
+  printf("\t--cache-dir=DIR --cache, kept in DIR\n");
+  printf("\t--cache-size=MB least recently used entries go past this "
+         "(default %d)\n",
+         SML_CACHE_SIZE_MB);
+  printf("\t--cache-stats   print cache hits and misses\n");
+  printf("\t--time-report   print the time spent in each phase\n");
+  printf("\t--mem-report    print the memory each phase allocates, peak "
+         "RSS and\n\t                what LLVM holds\n");
+  printf("\t--trace=FILE    write the phases as a Chrome trace, for "
+         "chrome://tracing\n\t                or ui.perfetto.dev\n");
+  printf("\t-O0 .. -O3      optimization level, -O is -O2 (default -O0)\n");
+  printf("\t-march=native   tune for and use every feature of this host\n");
+  printf("\t-mcpu=CPU       target CPU, -march=CPU is the same\n");
+  printf("\t-mattr=FEATURES CPU features to add or remove, as in "
+         "+avx2,-fma\n");
+  printf("\t--emit=KIND     ll (default), bc, asm or obj\n");
+  printf("\t-o FILE         output file, default is the source file with "
+         "the\n\t                extension of the output kind\n");
+  printf("\t--passes=PIPELINE\n");
+  printf("\t                run this pass pipeline instead, in opt -passes "
+         "syntax\n");
 }
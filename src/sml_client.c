@@ -0,0 +1,74 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "server.h"
+
+/*
+ * sml_client [--socket=PATH] <sml arguments>
+ *
+ * Thin client of `sml --server` for build systems: hands the arguments to
+ * the server and exits with its status. Without a server, or for what the
+ * server doesn't do (run, stdin, the options of SmlArgs_LocalOnly), it
+ * becomes the sml next to it instead.
+ */
+
+// Prefixes of the options SmlArgs_LocalOnly names, this client doesn't
+// parse arguments
+static const char *const local_only[] = {
+    "--time-report", "--trace=",     "--mem-report",
+    "--cache",       "--pretokenize", "--parallel-",
+};
+
+static bool is_local_only(const char *arg) {
+  for (size_t i = 0; i < sizeof(local_only) / sizeof(local_only[0]); ++i) {
+    if (strncmp(arg, local_only[i], strlen(local_only[i])) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  const char *socket_path = NULL;
+  int first = 1;
+  if (argc > 1 && strncmp(argv[1], "--socket=", 9) == 0) {
+    socket_path = argv[1] + 9;
+    first = 2;
+  }
+
+  bool forward = argc > first && strcmp(argv[first], "run") != 0;
+  for (int i = first; i < argc; ++i) {
+    forward = forward && strcmp(argv[i], "-") != 0 &&
+              strcmp(argv[i], "--server") != 0 && !is_local_only(argv[i]);
+  }
+  if (forward) {
+    char *default_path = socket_path ? NULL : Server_DefaultSocket();
+    int status = Server_Forward(socket_path ? socket_path : default_path,
+                                argc - first, argv + first);
+    free(default_path);
+    if (status >= 0) {
+      return status;
+    }
+  }
+
+  // argv[first - 1] becomes sml's argv[0]
+  char *sml = "sml";
+  const char *slash = strrchr(argv[0], '/');
+  if (slash) {
+    size_t dir_len = slash - argv[0] + 1;
+    sml = malloc(dir_len + sizeof("sml"));
+    memcpy(sml, argv[0], dir_len);
+    strcpy(sml + dir_len, "sml");
+  }
+  argv[first - 1] = sml;
+  if (slash) {
+    execv(sml, argv + first - 1);
+  } else {
+    execvp(sml, argv + first - 1);
+  }
+  fprintf(stderr, "[Error] Unable to run %s\n", sml);
+  return 1;
+}
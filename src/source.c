@@ -0,0 +1,115 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mem.h"
+#include "source.h"
+
+#define SOURCE_READ_CHUNK (64 * 1024)
+
+static int source_map(int fd, size_t len, SourceFile *source);
+static int source_read(int fd, const char *path, SourceFile *source,
+                       Diagnostics *diag);
+
+int SourceFile_Open(const char *path, SourceFile *source, Diagnostics *diag) {
+  source->data = "";
+  source->len = 0;
+  source->mapped = false;
+
+  bool is_stdin = strcmp(path, "-") == 0;
+  int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+  if (fd < 0) {
+    Diagnostics_Error(diag, "Couldn't open file %s: %s", path,
+                      strerror(errno));
+    return 1;
+  }
+
+  struct stat st;
+  int status;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      source_map(fd, st.st_size, source) == 0) {
+    status = 0;
+  } else {
+    status = source_read(fd, path, source, diag);
+  }
+
+  if (!is_stdin) {
+    close(fd);
+  }
+  return status;
+}
+
+void SourceFile_Close(SourceFile *source) {
+  if (source->mapped) {
+    munmap((void *)source->data, source->len);
+  } else if (source->len > 0) {
+    Mem_Free((void *)source->data);
+  }
+  source->data = "";
+  source->len = 0;
+  source->mapped = false;
+}
+
+static int source_map(int fd, size_t len, SourceFile *source) {
+  void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return 1;
+  }
+  // the lexer makes a single front-to-back pass
+  madvise(data, len, MADV_SEQUENTIAL);
+
+  source->data = data;
+  source->len = len;
+  source->mapped = true;
+  return 0;
+}
+
+// Fallback for anything that can't be mapped: pipes, terminals, empty files
+static int source_read(int fd, const char *path, SourceFile *source,
+                       Diagnostics *diag) {
+  char *data = NULL;
+  size_t len = 0;
+  size_t capacity = 0;
+
+  for (;;) {
+    if (capacity - len < SOURCE_READ_CHUNK) {
+      capacity = capacity ? capacity * 2 : SOURCE_READ_CHUNK;
+      char *grown = Mem_Realloc(data, capacity);
+      if (!grown) {
+        perror("Unable to allocate memory");
+        Mem_Free(data);
+        return 1;
+      }
+      data = grown;
+    }
+
+    ssize_t n = read(fd, data + len, capacity - len);
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Diagnostics_Error(diag, "Couldn't read file %s: %s", path,
+                        strerror(errno));
+      Mem_Free(data);
+      return 1;
+    }
+    len += n;
+  }
+
+  if (len == 0) {
+    Mem_Free(data);
+    return 0;
+  }
+
+  source->data = data;
+  source->len = len;
+  return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef SML_SOURCE
+#define SML_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "diag.h"
+
+// Read-only view of a source file. Regular files are mapped straight into
+// memory; pipes and stdin ("-") are read into a heap buffer instead. The data
+// is NOT null-terminated, always pair it with len.
+typedef struct {
+  const char *data;
+  size_t len;
+  bool mapped;
+} SourceFile;
+
+// Non-zero, after reporting why in diag, if path can't be read
+int SourceFile_Open(const char *path, SourceFile *source, Diagnostics *diag);
+void SourceFile_Close(SourceFile *source);
+
+#endif
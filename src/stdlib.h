@@ -14,6 +14,7 @@ typedef struct {
 } StdLib;
 
 void init_std_lib(StdLib **lib);
+void free_std_lib(StdLib *lib);
 BuiltinFn *find_builtin_fn(const StdLib *stdlib, char *name);
 
 #endif
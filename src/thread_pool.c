@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+static void *thread_pool_worker(void *arg);
+
+size_t ThreadPool_DefaultSize(void) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores > 0 ? (size_t)cores : 1;
+}
+
+ThreadPool *ThreadPool_New(size_t thread_count) {
+  ThreadPool *pool = malloc(sizeof(ThreadPool));
+  pool->thread_count = thread_count ? thread_count : ThreadPool_DefaultSize();
+  pool->threads = malloc(sizeof(pthread_t) * pool->thread_count);
+  pool->capacity = 64;
+  pool->jobs = malloc(sizeof(ThreadPoolJob) * pool->capacity);
+  pool->head = 0;
+  pool->queued = 0;
+  pool->running = 0;
+  pool->stopping = false;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->has_work, NULL);
+  pthread_cond_init(&pool->all_done, NULL);
+
+  for (size_t i = 0; i < pool->thread_count; ++i) {
+    if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool) !=
+        0) {
+      perror("Unable to start worker thread");
+      exit(1);
+    }
+  }
+  return pool;
+}
+
+void ThreadPool_Submit(ThreadPool *pool, ThreadPoolTask fn, void *arg) {
+  pthread_mutex_lock(&pool->lock);
+
+  if (pool->queued == pool->capacity) {
+    size_t new_capacity = pool->capacity * 2;
+    ThreadPoolJob *jobs = malloc(sizeof(ThreadPoolJob) * new_capacity);
+    for (size_t i = 0; i < pool->queued; ++i) {
+      jobs[i] = pool->jobs[(pool->head + i) % pool->capacity];
+    }
+    free(pool->jobs);
+    pool->jobs = jobs;
+    pool->head = 0;
+    pool->capacity = new_capacity;
+  }
+
+  ThreadPoolJob job = {.fn = fn, .arg = arg};
+  pool->jobs[(pool->head + pool->queued) % pool->capacity] = job;
+  pool->queued++;
+
+  pthread_cond_signal(&pool->has_work);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Block until every submitted job has finished
+void ThreadPool_Wait(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->queued > 0 || pool->running > 0) {
+    pthread_cond_wait(&pool->all_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void ThreadPool_Free(ThreadPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->has_work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t i = 0; i < pool->thread_count; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->has_work);
+  pthread_cond_destroy(&pool->all_done);
+  free(pool->jobs);
+  free(pool->threads);
+  free(pool);
+}
+
+static void *thread_pool_worker(void *arg) {
+  ThreadPool *pool = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->queued == 0 && !pool->stopping) {
+      pthread_cond_wait(&pool->has_work, &pool->lock);
+    }
+    if (pool->queued == 0 && pool->stopping) {
+      break;
+    }
+
+    ThreadPoolJob job = pool->jobs[pool->head];
+    pool->head = (pool->head + 1) % pool->capacity;
+    pool->queued--;
+    pool->running++;
+    pthread_mutex_unlock(&pool->lock);
+
+    job.fn(job.arg);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running--;
+    if (pool->queued == 0 && pool->running == 0) {
+      pthread_cond_broadcast(&pool->all_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
@@ -0,0 +1,39 @@
+#ifndef SML_THREAD_POOL
+#define SML_THREAD_POOL
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*ThreadPoolTask)(void *arg);
+
+typedef struct {
+  ThreadPoolTask fn;
+  void *arg;
+} ThreadPoolJob;
+
+typedef struct {
+  pthread_t *threads;
+  size_t thread_count;
+
+  pthread_mutex_t lock;
+  pthread_cond_t has_work;
+  pthread_cond_t all_done;
+
+  // FIFO ring of queued jobs
+  ThreadPoolJob *jobs;
+  size_t head;
+  size_t queued;
+  size_t capacity;
+
+  size_t running;
+  bool stopping;
+} ThreadPool;
+
+size_t ThreadPool_DefaultSize(void);
+ThreadPool *ThreadPool_New(size_t thread_count);
+void ThreadPool_Submit(ThreadPool *, ThreadPoolTask fn, void *arg);
+void ThreadPool_Wait(ThreadPool *);
+void ThreadPool_Free(ThreadPool *);
+
+#endif
@@ -0,0 +1,416 @@
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timing.h"
+
+// Scopes of this many detailed events are listed by Timing_Report
+#define TIMING_SLOWEST 10
+
+typedef struct TimingEvent {
+  const char *name;
+  char *detail;
+  uint64_t start, end;          // ns
+  uint32_t parent;              // enclosing scope, UINT32_MAX for none
+  uint64_t bytes, allocs;       // through Timing_Allocated, not nested ones
+  size_t heap_start, heap_end;  // in use, when tracking the heap
+} TimingEvent;
+
+typedef struct TimingThread {
+  uint32_t id;
+  TimingEvent *events;
+  size_t count, capacity;
+  uint32_t current;             // innermost open scope, UINT32_MAX for none
+  uint64_t bytes, allocs;       // outside any scope
+  struct TimingThread *next;
+} TimingThread;
+
+// One node of the report, the scopes of a name under one parent summed
+typedef struct TimingNode {
+  const char *name;
+  uint64_t total;
+  size_t count;
+  uint64_t bytes, allocs;
+  int64_t heap;
+  struct TimingNode *children, *next;
+} TimingNode;
+
+bool timing_enabled = false;
+static bool timing_heap = false;
+static uint64_t timing_origin;
+static uint64_t timing_counters[TIMING_COUNTER_COUNT];
+static pthread_mutex_t timing_lock = PTHREAD_MUTEX_INITIALIZER;
+static TimingThread *timing_threads;
+static uint32_t timing_thread_count;
+static _Thread_local TimingThread *timing_self;
+
+static const char *const counter_names[TIMING_COUNTER_COUNT] = {
+    [TIMING_TOKENS] = "tokens lexed",
+    [TIMING_AST_NODES] = "AST nodes",
+    [TIMING_IR_INSTRUCTIONS] = "IR instructions emitted",
+    [TIMING_BYTES_WRITTEN] = "bytes written",
+};
+
+static uint64_t now_ns(void);
+static size_t heap_in_use(void);
+static TimingThread *timing_thread(void);
+static void tree_build(const TimingThread *thread, TimingNode *root);
+static TimingNode *node_child(TimingNode *parent, const char *name);
+static void node_print(FILE *out, const TimingNode *node, int depth,
+                       uint64_t wall);
+static void node_print_memory(FILE *out, const TimingNode *node, int depth);
+static void node_sum(const TimingNode *node, uint64_t *bytes,
+                     uint64_t *allocs);
+static void node_free(TimingNode *node);
+static void json_string(FILE *out, const char *string);
+static int compare_durations(const void *a, const void *b);
+
+void Timing_Enable(void) {
+  timing_origin = now_ns();
+  timing_enabled = true;
+}
+
+void Timing_TrackHeap(void) { timing_heap = true; }
+
+TimingScope Timing_Begin(const char *name, const char *detail) {
+  if (!timing_enabled) {
+    return (TimingScope){UINT32_MAX};
+  }
+  TimingThread *thread = timing_thread();
+  if (thread->count == thread->capacity) {
+    thread->capacity = thread->capacity ? thread->capacity * 2 : 256;
+    thread->events =
+        realloc(thread->events, sizeof(TimingEvent) * thread->capacity);
+    if (!thread->events) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+  }
+  thread->events[thread->count] = (TimingEvent){
+      .name = name,
+      .detail = detail ? strdup(detail) : NULL,
+      .parent = thread->current,
+      .heap_start = timing_heap ? heap_in_use() : 0,
+      .start = now_ns(),
+  };
+  thread->current = thread->count;
+  return (TimingScope){thread->count++};
+}
+
+void Timing_End(TimingScope scope) {
+  if (scope.index == UINT32_MAX) {
+    return;
+  }
+  TimingThread *thread = timing_self;
+  TimingEvent *event = &thread->events[scope.index];
+  event->end = now_ns();
+  if (timing_heap) {
+    event->heap_end = heap_in_use();
+  }
+  thread->current = event->parent;
+}
+
+void Timing_Unwind(TimingScope scope) {
+  if (scope.index == UINT32_MAX) {
+    return;
+  }
+  TimingThread *thread = timing_self;
+  uint64_t end = now_ns();
+  size_t heap = timing_heap ? heap_in_use() : 0;
+  for (size_t i = scope.index; i < thread->count; ++i) {
+    if (thread->events[i].end == 0) {
+      thread->events[i].end = end;
+      thread->events[i].heap_end = heap;
+    }
+  }
+  thread->current = thread->events[scope.index].parent;
+}
+
+void Timing_Allocated(size_t bytes) {
+  if (!timing_enabled) {
+    return;
+  }
+  TimingThread *thread = timing_thread();
+  if (thread->current == UINT32_MAX) {
+    thread->bytes += bytes;
+    thread->allocs++;
+  } else {
+    thread->events[thread->current].bytes += bytes;
+    thread->events[thread->current].allocs++;
+  }
+}
+
+void Timing_Count(TimingCounter counter, uint64_t amount) {
+  if (timing_enabled) {
+    __atomic_fetch_add(&timing_counters[counter], amount, __ATOMIC_RELAXED);
+  }
+}
+
+void Timing_Report(FILE *out) {
+  uint64_t wall = now_ns() - timing_origin;
+  fprintf(out, "===== sml time report (%.3f ms wall) =====\n", wall / 1e6);
+  fprintf(out, "%12s %7s %8s  %s\n", "ms", "%", "count", "phase");
+
+  size_t detailed = 0;
+  pthread_mutex_lock(&timing_lock);
+  for (TimingThread *thread = timing_threads; thread; thread = thread->next) {
+    TimingNode root = {.name = "thread"};
+    tree_build(thread, &root);
+    for (size_t i = 0; i < thread->count; ++i) {
+      detailed += thread->events[i].detail != NULL;
+    }
+    fprintf(out, "-- thread %u\n", thread->id);
+    for (TimingNode *child = root.children; child; child = child->next) {
+      node_print(out, child, 0, wall);
+    }
+    node_free(root.children);
+  }
+
+  const TimingEvent **slowest = malloc(sizeof(TimingEvent *) * (detailed + 1));
+  size_t slow_count = 0;
+  for (TimingThread *thread = timing_threads; thread && slowest;
+       thread = thread->next) {
+    for (size_t i = 0; i < thread->count; ++i) {
+      if (thread->events[i].detail) {
+        slowest[slow_count++] = &thread->events[i];
+      }
+    }
+  }
+  if (slow_count > 0) {
+    qsort(slowest, slow_count, sizeof(TimingEvent *), compare_durations);
+    fprintf(out, "-- slowest\n");
+    for (size_t i = 0; i < slow_count && i < TIMING_SLOWEST; ++i) {
+      fprintf(out, "%12.3f          %8s  %s %s\n",
+              (slowest[i]->end - slowest[i]->start) / 1e6, "",
+              slowest[i]->name, slowest[i]->detail);
+    }
+  }
+  free(slowest);
+  pthread_mutex_unlock(&timing_lock);
+
+  fprintf(out, "-- counters\n");
+  for (int i = 0; i < TIMING_COUNTER_COUNT; ++i) {
+    fprintf(out, "%12llu  %s\n",
+            (unsigned long long)__atomic_load_n(&timing_counters[i],
+                                                __ATOMIC_RELAXED),
+            counter_names[i]);
+  }
+}
+
+void Timing_ReportMemory(FILE *out) {
+  fprintf(out, "%12s %8s %12s  %s\n", "bytes", "allocs", "heap +/-",
+          "phase");
+  pthread_mutex_lock(&timing_lock);
+  for (TimingThread *thread = timing_threads; thread; thread = thread->next) {
+    TimingNode root = {.name = "outside phases"};
+    tree_build(thread, &root);
+    fprintf(out, "-- thread %u\n", thread->id);
+    if (root.allocs > 0) {
+      fprintf(out, "%12llu %8llu %12s  %s\n", (unsigned long long)root.bytes,
+              (unsigned long long)root.allocs, "", root.name);
+    }
+    for (TimingNode *child = root.children; child; child = child->next) {
+      node_print_memory(out, child, 0);
+    }
+    node_free(root.children);
+  }
+  pthread_mutex_unlock(&timing_lock);
+}
+
+int Timing_WriteTrace(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    perror("[Error] Unable to write the trace");
+    return 1;
+  }
+
+  fprintf(out, "{\"traceEvents\":[\n");
+  bool first = true;
+  uint64_t last = 0;
+  pthread_mutex_lock(&timing_lock);
+  for (TimingThread *thread = timing_threads; thread; thread = thread->next) {
+    for (size_t i = 0; i < thread->count; ++i) {
+      const TimingEvent *event = &thread->events[i];
+      fprintf(out, "%s{\"name\":", first ? "" : ",\n");
+      json_string(out, event->name);
+      fprintf(out,
+              ",\"cat\":\"sml\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+              "\"ts\":%.3f,\"dur\":%.3f",
+              thread->id, (event->start - timing_origin) / 1e3,
+              (event->end - event->start) / 1e3);
+      if (event->detail) {
+        fprintf(out, ",\"args\":{\"detail\":");
+        json_string(out, event->detail);
+        fprintf(out, "}");
+      }
+      fprintf(out, "}");
+      first = false;
+      last = event->end > last ? event->end : last;
+    }
+  }
+  pthread_mutex_unlock(&timing_lock);
+
+  // the counters once, at the end of the trace
+  fprintf(out, "%s{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,"
+               "\"ts\":%.3f,\"args\":{",
+          first ? "" : ",\n",
+          (last > timing_origin ? last - timing_origin : 0) / 1e3);
+  for (int i = 0; i < TIMING_COUNTER_COUNT; ++i) {
+    fprintf(out, "%s", i ? "," : "");
+    json_string(out, counter_names[i]);
+    fprintf(out, ":%llu",
+            (unsigned long long)__atomic_load_n(&timing_counters[i],
+                                                __ATOMIC_RELAXED));
+  }
+  fprintf(out, "}}\n]}\n");
+
+  if (fclose(out) != 0) {
+    perror("[Error] Unable to write the trace");
+    return 1;
+  }
+  return 0;
+}
+
+// Whatever malloc hands out, sbrk and mmap alike, so LLVM's too
+static size_t heap_in_use(void) {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Registered on its first scope, kept until the process exits so a trace
+// can be written after the thread is gone
+static TimingThread *timing_thread(void) {
+  if (timing_self) {
+    return timing_self;
+  }
+  TimingThread *thread = calloc(1, sizeof(TimingThread));
+  if (!thread) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  thread->current = UINT32_MAX;
+  pthread_mutex_lock(&timing_lock);
+  thread->id = timing_thread_count++;
+  // appended, so the main thread, first to time anything, is listed first
+  TimingThread **tail = &timing_threads;
+  while (*tail) {
+    tail = &(*tail)->next;
+  }
+  *tail = thread;
+  pthread_mutex_unlock(&timing_lock);
+  timing_self = thread;
+  return thread;
+}
+
+// Sums the thread's scopes into a tree under root, root itself gets what was
+// allocated outside of them
+static void tree_build(const TimingThread *thread, TimingNode *root) {
+  root->bytes = thread->bytes;
+  root->allocs = thread->allocs;
+  TimingNode **nodes = malloc(sizeof(TimingNode *) * (thread->count + 1));
+  if (!nodes) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  // events are in begin order, a parent before its children
+  for (size_t i = 0; i < thread->count; ++i) {
+    const TimingEvent *event = &thread->events[i];
+    TimingNode *parent =
+        event->parent == UINT32_MAX ? root : nodes[event->parent];
+    TimingNode *node = nodes[i] = node_child(parent, event->name);
+    node->total += event->end - event->start;
+    node->count++;
+    node->bytes += event->bytes;
+    node->allocs += event->allocs;
+    node->heap += (int64_t)event->heap_end - (int64_t)event->heap_start;
+  }
+  free(nodes);
+}
+
+static TimingNode *node_child(TimingNode *parent, const char *name) {
+  TimingNode **link = &parent->children;
+  for (; *link; link = &(*link)->next) {
+    if (strcmp((*link)->name, name) == 0) {
+      return *link;
+    }
+  }
+  *link = calloc(1, sizeof(TimingNode));
+  if (!*link) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  (*link)->name = name;
+  return *link;
+}
+
+static void node_print(FILE *out, const TimingNode *node, int depth,
+                       uint64_t wall) {
+  fprintf(out, "%12.3f %6.1f%% %8zu  %*s%s\n", node->total / 1e6,
+          wall ? 100.0 * node->total / wall : 0.0, node->count, depth * 2, "",
+          node->name);
+  for (TimingNode *child = node->children; child; child = child->next) {
+    node_print(out, child, depth + 1, wall);
+  }
+}
+
+// Bytes and allocations include the nested scopes', as times do
+static void node_print_memory(FILE *out, const TimingNode *node, int depth) {
+  uint64_t bytes = node->bytes, allocs = node->allocs;
+  for (const TimingNode *child = node->children; child; child = child->next) {
+    node_sum(child, &bytes, &allocs);
+  }
+  fprintf(out, "%12llu %8llu %+12lld  %*s%s\n", (unsigned long long)bytes,
+          (unsigned long long)allocs, (long long)node->heap, depth * 2, "",
+          node->name);
+  for (TimingNode *child = node->children; child; child = child->next) {
+    node_print_memory(out, child, depth + 1);
+  }
+}
+
+static void node_sum(const TimingNode *node, uint64_t *bytes,
+                     uint64_t *allocs) {
+  *bytes += node->bytes;
+  *allocs += node->allocs;
+  for (const TimingNode *child = node->children; child; child = child->next) {
+    node_sum(child, bytes, allocs);
+  }
+}
+
+static void node_free(TimingNode *node) {
+  while (node) {
+    TimingNode *next = node->next;
+    node_free(node->children);
+    free(node);
+    node = next;
+  }
+}
+
+static void json_string(FILE *out, const char *string) {
+  fputc('"', out);
+  for (const char *c = string; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(out, "\\%c", *c);
+    } else if ((unsigned char)*c < 0x20) {
+      fprintf(out, "\\u%04x", *c);
+    } else {
+      fputc(*c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+// longest first
+static int compare_durations(const void *a, const void *b) {
+  const TimingEvent *x = *(const TimingEvent *const *)a;
+  const TimingEvent *y = *(const TimingEvent *const *)b;
+  uint64_t dx = x->end - x->start, dy = y->end - y->start;
+  return dx > dy ? -1 : dx < dy;
+}
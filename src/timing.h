@@ -0,0 +1,51 @@
+#ifndef SML_TIMING
+#define SML_TIMING
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Counters shown with the phases, bumped from any thread
+typedef enum TimingCounter {
+  TIMING_TOKENS,
+  TIMING_AST_NODES,
+  TIMING_IR_INSTRUCTIONS,
+  TIMING_BYTES_WRITTEN,
+  TIMING_COUNTER_COUNT,
+} TimingCounter;
+
+typedef struct TimingScope {
+  uint32_t index; // into the thread's events, UINT32_MAX when off
+} TimingScope;
+
+/*
+ * Phase timers for --time-report and --trace. Scopes nest per thread and
+ * are recorded into a buffer of the thread's own, so timing takes no lock;
+ * while off, a scope costs a branch.
+ */
+extern bool timing_enabled;
+
+void Timing_Enable(void);
+// detail, copied, tells apart scopes of one name such as each function
+TimingScope Timing_Begin(const char *name, const char *detail);
+void Timing_End(TimingScope scope);
+// Ends scope along with whatever a longjmp left open inside it
+void Timing_Unwind(TimingScope scope);
+void Timing_Count(TimingCounter counter, uint64_t amount);
+// Record the heap in use around every scope as well, costly
+void Timing_TrackHeap(void);
+// Charged to the calling thread's innermost scope, see mem.h
+void Timing_Allocated(size_t bytes);
+
+// Scopes of the same name under the same parent summed, per thread, with
+// the counters and the slowest detailed scopes
+void Timing_Report(FILE *out);
+// Chrome trace event JSON, opens in chrome://tracing and Perfetto.
+// Non-zero after reporting why if path can't be written.
+int Timing_WriteTrace(const char *path);
+// Bytes and allocations charged to each phase, and how the heap grew
+// across it, in the tree of Timing_Report
+void Timing_ReportMemory(FILE *out);
+
+#endif
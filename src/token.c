@@ -1,6 +1,6 @@
 #include "token.h"
 
-void Token_Inspect(Token *token) {
+void Token_Inspect(const char *source, Token *token, TokenPosition position) {
   switch (token->type) {
   case TOKEN_EOF:
     printf("EOF ");
@@ -8,14 +8,12 @@ void Token_Inspect(Token *token) {
   case TOKEN_ARROW:
     printf("SYMBOL: -> ");
     break;
-  case TOKEN_FN_DECL:
-    printf("KEYWORD: function ");
-    break;
   case TOKEN_IDENT:
-    printf("IDENT: %s ", token->value.string);
+    printf("IDENT: %.*s ", (int)token->span.len, source + token->span.start);
     break;
   case TOKEN_STRING:
-    printf("STRING: \"%s\" ", token->value.string);
+    printf("STRING: \"%.*s\" ", (int)token->span.len,
+           source + token->span.start);
     break;
   case TOKEN_NUMBER:
     printf("NUMBER: %lld ", token->value.number);
@@ -23,37 +21,47 @@ void Token_Inspect(Token *token) {
   case TOKEN_ILLEGAL:
     printf("ILLEGAL: \"%c\" ", token->value.char_);
     break;
-  case TOKEN_LPAREN:
-    printf("SYMBOL: ( ");
-    break;
-  case TOKEN_RPAREN:
-    printf("SYMBOL: ) ");
-    break;
-  case TOKEN_LBRACE:
-    printf("SYMBOL: { ");
-    break;
-  case TOKEN_RBRACE:
-    printf("SYMBOL: } ");
-    break;
-  case TOKEN_SEMICOLON:
-    printf("SYMBOL: ; ");
-    break;
-  case TOKEN_PLUS:
-    printf("SYMBOL: + ");
-    break;
-  case TOKEN_EQUAL:
-    printf("SYMBOL: = ");
-    break;
-  case TOKEN_RETURN:
-    printf("KEYWORD: return ");
-    break;
-  case TOKEN_TYPE_INT:
-    printf("KEYWORD: int ");
+#define X(type, ch)                                                            \
+  case type:                                                                   \
+    printf("SYMBOL: %c ", ch);                                                 \
     break;
-  case TOKEN_LET:
-    printf("KEYWORD: let ");
+    SML_TOKEN_SYMBOLS(X)
+#undef X
+#define X(type, text, first)                                                   \
+  case type:                                                                   \
+    printf("KEYWORD: %s ", text);                                              \
     break;
+    SML_TOKEN_KEYWORDS(X)
+#undef X
   }
 
-  printf("%zu:%zu\n", token->position.line, token->position.colm);
+  printf("%zu:%zu\n", position.line, position.colm);
+}
+
+const char *Token_TypeText(TokenType type) {
+  switch (type) {
+  case TOKEN_EOF:
+    return "end of file";
+  case TOKEN_ILLEGAL:
+    return "an illegal character";
+  case TOKEN_IDENT:
+    return "an identifier";
+  case TOKEN_NUMBER:
+    return "a number";
+  case TOKEN_STRING:
+    return "a string";
+  case TOKEN_ARROW:
+    return "'->'";
+#define X(type, ch)                                                            \
+  case type:                                                                   \
+    return #ch;
+    SML_TOKEN_SYMBOLS(X)
+#undef X
+#define X(type, text, first)                                                   \
+  case type:                                                                   \
+    return "'" text "'";
+    SML_TOKEN_KEYWORDS(X)
+#undef X
+  }
+  return "an unknown token";
 }
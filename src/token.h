@@ -31,19 +31,49 @@ typedef enum {
   TOKEN_LET,
 } TokenType;
 
+// Token tables. Adding a single-character symbol or a keyword is a one line
+// change here: the lexer's character-class, dispatch and keyword tables,
+// Token_Inspect and Token_TypeText are all generated from these lists.
+#define SML_TOKEN_SYMBOLS(X)                                                   \
+  X(TOKEN_LPAREN, '(')                                                         \
+  X(TOKEN_RPAREN, ')')                                                         \
+  X(TOKEN_LBRACE, '{')                                                         \
+  X(TOKEN_RBRACE, '}')                                                         \
+  X(TOKEN_SEMICOLON, ';')                                                      \
+  X(TOKEN_PLUS, '+')                                                           \
+  X(TOKEN_EQUAL, '=')
+
+// (type, text, first char of text)
+#define SML_TOKEN_KEYWORDS(X)                                                  \
+  X(TOKEN_FN_DECL, "function", 'f')                                            \
+  X(TOKEN_TYPE_INT, "int", 'i')                                                \
+  X(TOKEN_RETURN, "return", 'r')                                               \
+  X(TOKEN_LET, "let", 'l')
+
+// Tokens never own text: identifiers and strings are a span into the lexer
+// buffer (string spans exclude the quotes).
+typedef struct {
+  size_t start;
+  size_t len;
+} TokenSpan;
+
+typedef struct {
+  size_t line;
+  size_t colm;
+} TokenPosition;
+
 typedef struct {
   TokenType type;
   union {
     char char_;
-    char *string;
     long long number;
   } value;
-  struct {
-    size_t line;
-    size_t colm;
-  } position;
+  TokenSpan span;
 } Token;
 
-void Token_Inspect(Token *token);
+void Token_Inspect(const char *source, Token *token, TokenPosition position);
+// How a token of this type is spelled, for diagnostics: "'('", "'let'",
+// "an identifier", ...
+const char *Token_TypeText(TokenType type);
 
 #endif
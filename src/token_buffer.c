@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lexer.h"
+#include "mem.h"
+#include "token.h"
+#include "thread_pool.h"
+#include "token_buffer.h"
+
+typedef struct {
+  Lexer lexer;
+  TokenBuffer tokens;
+  int status;
+} LexChunk;
+
+static void token_buffer_reserve(TokenBuffer *, size_t capacity);
+static size_t find_chunk_bounds(const Lexer *, size_t *bounds,
+                                size_t chunk_count);
+static void lex_chunk(void *arg);
+
+TokenBuffer TokenBuffer_New(void) {
+  TokenBuffer tokens;
+  tokens.types = NULL;
+  tokens.starts = NULL;
+  tokens.lens = NULL;
+  tokens.values = NULL;
+  tokens.count = 0;
+  tokens.capacity = 0;
+  return tokens;
+}
+
+int TokenBuffer_Lex(TokenBuffer *tokens, Lexer *l) {
+  if (l->buffer_len > UINT32_MAX) {
+    fprintf(stderr, "[Error] Source too large to pre-tokenize\n");
+    return 1;
+  }
+
+  // roughly one token per 4 bytes of source
+  token_buffer_reserve(tokens, tokens->count + l->buffer_len / 4 + 1);
+
+  Token token;
+  do {
+    token = Lexer_NextToken(l);
+    TokenBuffer_Push(tokens, token);
+  } while (token.type != TOKEN_EOF);
+
+  return 0;
+}
+
+// Split the source at newlines outside string literals, lex the pieces on the
+// pool and concatenate the results. Spans are absolute offsets into the one
+// source buffer, so stitching needs no fix-ups: line/column still come from
+// Lexer_Position on the shared buffer. The resulting stream is identical to
+// TokenBuffer_Lex's.
+int TokenBuffer_LexParallel(TokenBuffer *tokens, Lexer *l, ThreadPool *pool) {
+  size_t chunk_count = (l->buffer_len - l->pos) / SML_LEX_MIN_CHUNK;
+  if (chunk_count > pool->thread_count * 4) {
+    chunk_count = pool->thread_count * 4;
+  }
+  if (chunk_count < 2 || l->buffer_len > UINT32_MAX) {
+    return TokenBuffer_Lex(tokens, l);
+  }
+
+  size_t bounds[chunk_count + 1];
+  chunk_count = find_chunk_bounds(l, bounds, chunk_count);
+
+  LexChunk *chunks = Mem_Alloc(sizeof(LexChunk) * chunk_count);
+  for (size_t i = 0; i < chunk_count; ++i) {
+    chunks[i].lexer = Lexer_New(l->buffer, bounds[i + 1]);
+    chunks[i].lexer.pos = bounds[i];
+    chunks[i].tokens = TokenBuffer_New();
+    ThreadPool_Submit(pool, lex_chunk, &chunks[i]);
+  }
+  ThreadPool_Wait(pool);
+
+  int status = 0;
+  size_t total = tokens->count;
+  for (size_t i = 0; i < chunk_count; ++i) {
+    status |= chunks[i].status;
+    total += chunks[i].tokens.count;
+  }
+  token_buffer_reserve(tokens, total);
+
+  for (size_t i = 0; i < chunk_count; ++i) {
+    TokenBuffer *chunk = &chunks[i].tokens;
+    // only the last chunk keeps its EOF
+    size_t n = i + 1 < chunk_count ? chunk->count - 1 : chunk->count;
+    size_t at = tokens->count;
+    memcpy(tokens->types + at, chunk->types, sizeof(uint8_t) * n);
+    memcpy(tokens->starts + at, chunk->starts, sizeof(uint32_t) * n);
+    memcpy(tokens->lens + at, chunk->lens, sizeof(uint32_t) * n);
+    memcpy(tokens->values + at, chunk->values, sizeof(long long) * n);
+    tokens->count += n;
+    TokenBuffer_Free(chunk);
+  }
+  Mem_Free(chunks);
+
+  l->pos = bounds[chunk_count];
+  return status;
+}
+
+void TokenBuffer_Push(TokenBuffer *tokens, Token token) {
+  if (tokens->count == tokens->capacity) {
+    token_buffer_reserve(tokens, tokens->capacity ? tokens->capacity * 2 : 64);
+  }
+
+  size_t i = tokens->count++;
+  tokens->types[i] = token.type;
+  tokens->starts[i] = token.span.start;
+  tokens->lens[i] = token.span.len;
+  switch (token.type) {
+  case TOKEN_NUMBER:
+    tokens->values[i] = token.value.number;
+    break;
+  case TOKEN_ILLEGAL:
+    tokens->values[i] = token.value.char_;
+    break;
+  default:
+    tokens->values[i] = 0;
+    break;
+  }
+}
+
+Token TokenBuffer_At(const TokenBuffer *tokens, size_t index) {
+  Token token;
+  token.type = tokens->types[index];
+  token.span.start = tokens->starts[index];
+  token.span.len = tokens->lens[index];
+  if (token.type == TOKEN_ILLEGAL) {
+    token.value.char_ = tokens->values[index];
+  } else {
+    token.value.number = tokens->values[index];
+  }
+  return token;
+}
+
+void TokenBuffer_Free(TokenBuffer *tokens) {
+  Mem_Free(tokens->types);
+  Mem_Free(tokens->starts);
+  Mem_Free(tokens->lens);
+  Mem_Free(tokens->values);
+  *tokens = TokenBuffer_New();
+}
+
+/*
+ * Pre-scan for chunk boundaries. Hopping between quotes and null bytes with
+ * the string scan kernel tells which regions are inside a string literal; a
+ * boundary is placed right after the first newline outside a string at or
+ * past each evenly spaced target. A null byte outside a string ends the
+ * input for the lexer, so it also ends the last chunk.
+ *
+ * Returns the number of chunks, which may be fewer than asked for.
+ */
+static size_t find_chunk_bounds(const Lexer *l, size_t *bounds,
+                                size_t chunk_count) {
+  const char *buffer = l->buffer;
+  size_t end = l->buffer_len;
+  size_t start = l->pos;
+  size_t step = (end - start) / chunk_count;
+
+  size_t found = 1;
+  bounds[0] = start;
+  bool in_string = false;
+  size_t pos = start;
+
+  while (pos < end) {
+    size_t next = l->scan->scan_string(buffer, pos, end);
+
+    while (!in_string && found < chunk_count) {
+      size_t from = start + step * found;
+      if (from < pos) {
+        from = pos;
+      }
+      if (from < bounds[found - 1]) {
+        from = bounds[found - 1];
+      }
+      if (from >= next) {
+        break;
+      }
+      const char *newline = memchr(buffer + from, '\n', next - from);
+      if (!newline) {
+        break;
+      }
+      bounds[found++] = newline - buffer + 1;
+    }
+
+    if (next >= end) {
+      break;
+    }
+    if (buffer[next] == 0 && !in_string) {
+      end = next;
+      break;
+    }
+    // a quote toggles, a null byte inside a string terminates it
+    in_string = buffer[next] == '"' ? !in_string : false;
+    pos = next + 1;
+  }
+
+  // drop boundaries that fell past an early end
+  while (found > 1 && bounds[found - 1] >= end) {
+    found--;
+  }
+  bounds[found] = end;
+  return found;
+}
+
+static void lex_chunk(void *arg) {
+  LexChunk *chunk = arg;
+  chunk->status = TokenBuffer_Lex(&chunk->tokens, &chunk->lexer);
+}
+
+static void token_buffer_reserve(TokenBuffer *tokens, size_t capacity) {
+  if (capacity <= tokens->capacity) {
+    return;
+  }
+  tokens->types = Mem_Realloc(tokens->types, sizeof(uint8_t) * capacity);
+  tokens->starts = Mem_Realloc(tokens->starts, sizeof(uint32_t) * capacity);
+  tokens->lens = Mem_Realloc(tokens->lens, sizeof(uint32_t) * capacity);
+  tokens->values = Mem_Realloc(tokens->values, sizeof(long long) * capacity);
+  if (!tokens->types || !tokens->starts || !tokens->lens || !tokens->values) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  tokens->capacity = capacity;
+}
@@ -0,0 +1,33 @@
+#ifndef SML_TOKEN_BUFFER
+#define SML_TOKEN_BUFFER
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexer.h"
+#include "thread_pool.h"
+#include "token.h"
+
+// chunks smaller than this are not worth a thread
+#define SML_LEX_MIN_CHUNK (256 * 1024)
+
+// A whole file lexed up front, stored as parallel arrays so a parser walking
+// it only touches the fields it needs. Spans are 32-bit, which caps
+// pre-tokenized sources at 4 GiB. The last token is always TOKEN_EOF.
+typedef struct {
+  uint8_t *types;
+  uint32_t *starts;
+  uint32_t *lens;
+  long long *values; // number for TOKEN_NUMBER, char for TOKEN_ILLEGAL
+  size_t count;
+  size_t capacity;
+} TokenBuffer;
+
+TokenBuffer TokenBuffer_New(void);
+int TokenBuffer_Lex(TokenBuffer *, Lexer *);
+int TokenBuffer_LexParallel(TokenBuffer *, Lexer *, ThreadPool *);
+void TokenBuffer_Push(TokenBuffer *, Token);
+Token TokenBuffer_At(const TokenBuffer *, size_t index);
+void TokenBuffer_Free(TokenBuffer *);
+
+#endif
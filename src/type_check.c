@@ -2,43 +2,47 @@
 #include "type.h"
 
 typedef struct TypeCheckContext {
+  AST *ast;
   int error_count;
 } TypeCheckContext;
 
 int AST_type_check(AST *);
-void type_check_stmt_block(TypeCheckContext *, StmtBlock *);
+void type_check_stmt_block(TypeCheckContext *, StmtBlock);
 void type_check_stmt_vardecl(TypeCheckContext *, StmtVarDecl *);
-Type expr_to_type(StmtExpr *);
+Type expr_to_type(TypeCheckContext *, ExprId);
 
 int AST_type_check(AST *ast) {
   TypeCheckContext ctx;
+  ctx.ast = ast;
   ctx.error_count = 0;
 
-  type_check_stmt_block(&ctx, ast);
+  type_check_stmt_block(&ctx, ast->root);
 
   return ctx.error_count;
 }
 
-void type_check_stmt_block(TypeCheckContext *ctx, StmtBlock *block) {
-  for (size_t i = 0; i < block->stmt_count; ++i) {
-    Stmt *stmt = &block->stmts[i];
+void type_check_stmt_block(TypeCheckContext *ctx, StmtBlock block) {
+  AST *ast = ctx->ast;
+  for (uint32_t i = 0; i < block.stmt_count; ++i) {
+    StmtNode *stmt = &ast->stmts.items[AST_BlockStmt(ast, block, i)];
     switch (stmt->type) {
     case STMT_VAR_DECL:
-      type_check_stmt_vardecl(ctx, &stmt->value.var_decl);
+      type_check_stmt_vardecl(ctx, &ast->var_decls.items[stmt->index]);
       break;
     }
   }
 }
 
 void type_check_stmt_vardecl(TypeCheckContext *ctx, StmtVarDecl *var_decl) {
-  Type var_type = expr_to_type(var_decl->init);
+  Type var_type = expr_to_type(ctx, var_decl->init);
   var_decl->type = var_type;
 }
 
-Type expr_to_type(StmtExpr *expr) {
+Type expr_to_type(TypeCheckContext *ctx, ExprId id) {
+  ExprNode *expr = &ctx->ast->exprs.items[id];
   switch (expr->type) {
   case EXPR_LITERAL:
-    switch (expr->value.literal.type) {
+    switch (ctx->ast->literals.items[expr->index].type) {
     case EXPR_LITERAL_NUM:
       return TYPE_INT;
       break;
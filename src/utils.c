@@ -3,16 +3,27 @@
 #include <stdlib.h>
 #include <string.h>
 
-char *change_file_ext(char *fname_with_ext, char *ext) {
-  size_t name_len = 0;
-  while (name_len < strlen(fname_with_ext) && fname_with_ext[name_len] != '.') {
-    name_len++;
+#include "mem.h"
+
+char *change_file_ext(char *fname_with_ext, const char *ext) {
+  // only a dot inside the last path component, and not leading it, starts
+  // the extension
+  const char *base = strrchr(fname_with_ext, '/');
+  base = base ? base + 1 : fname_with_ext;
+  const char *dot = strrchr(base, '.');
+  size_t name_len = strlen(fname_with_ext);
+  if (dot && dot != base) {
+    name_len = dot - fname_with_ext;
   }
+
   size_t ext_len = strlen(ext);
-  char *out = malloc(sizeof(char) * (name_len + ext_len + 1));
-  strncpy(out, fname_with_ext, name_len);
-  strcat(out + name_len, ext);
-  out[name_len + ext_len] = '\0';
+  char *out = Mem_Alloc(sizeof(char) * (name_len + ext_len + 1));
+  if (!out) {
+    perror("Unable to allocate memory");
+    exit(1);
+  }
+  memcpy(out, fname_with_ext, name_len);
+  memcpy(out + name_len, ext, ext_len + 1);
   return out;
 }
 
@@ -20,7 +31,7 @@ void __unescape_str__(const char *src, char *dest);
 
 char *unescape_str(const char *src) {
   // Allocate memory for the unescaped string
-  char *dest = malloc(strlen(src) + 1); // +1 for null-terminator
+  char *dest = Mem_Alloc(strlen(src) + 1); // +1 for null-terminator
   if (!dest) {
     perror("Unable to allocate memory");
     return NULL;
@@ -2,6 +2,6 @@
 #define SML_UTILS
 
 char *unescape_str(const char *src);
-char *change_file_ext(char *fname_with_ext, char *ext);
+char *change_file_ext(char *fname_with_ext, const char *ext);
 
 #endif
@@ -0,0 +1,134 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <llvm-c/Core.h>
+
+#include "backend.h"
+#include "source.h"
+#include "timing.h"
+#include "worker.h"
+
+// The key only exists for its destructor, which frees a worker when its
+// thread exits; lookups go through the thread-local pointer
+static pthread_key_t worker_key;
+static pthread_once_t worker_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local CompileWorker *thread_worker;
+
+static void worker_key_create(void);
+static void worker_free(void *worker);
+static LLVMTargetMachineRef worker_machine(CompileWorker *, int opt_level,
+                                           const char *cpu,
+                                           const char *features,
+                                           Diagnostics *diag);
+
+CompileWorker *CompileWorker_ForThread(void) {
+  if (!thread_worker) {
+    pthread_once(&worker_key_once, worker_key_create);
+    CompileWorker *worker = calloc(1, sizeof(CompileWorker));
+    if (!worker) {
+      perror("Unable to allocate memory");
+      exit(1);
+    }
+    SmlCompiler_Init(&worker->compiler, NULL, NULL);
+    pthread_setspecific(worker_key, worker);
+    thread_worker = worker;
+  }
+  return thread_worker;
+}
+
+int CompileWorker_CompileFile(CompileWorker *worker, const SmlArgs *args,
+                              const char *source_path, char *source_name,
+                              char *output_path) {
+  if (worker->uses == SML_WORKER_CONTEXT_USES) {
+    SmlCompiler_Free(&worker->compiler);
+    SmlCompiler_Init(&worker->compiler, NULL, NULL);
+    worker->uses = 0;
+  }
+  Diagnostics *diag = &worker->compiler.diag;
+  Diagnostics_Clear(diag);
+  diag->source = args->source_count > 1 ? source_name : NULL;
+
+  LLVMTargetMachineRef machine = worker_machine(worker, args->opt_level,
+                                                args->cpu, args->features, diag);
+  if (!machine) {
+    return 1;
+  }
+
+  SourceFile source;
+  if (SourceFile_Open(source_path, &source, diag) != 0) {
+    return 1;
+  }
+  worker->uses++;
+  TimingScope timing = Timing_Begin("file", source_name);
+  LLVMModuleRef module = SmlCompiler_CompileModule(
+      &worker->compiler, source.data, source.len, source_name, machine);
+  SourceFile_Close(&source);
+  if (!module) {
+    Timing_End(timing);
+    return 1;
+  }
+
+  Backend_SetTarget(module, machine);
+  int status =
+      Backend_Optimize(module, machine, args->opt_level, args->passes, diag) ||
+      Backend_Emit(module, machine, args->emit, output_path, diag);
+  LLVMDisposeModule(module);
+  Timing_End(timing);
+  return status;
+}
+
+static void worker_key_create(void) {
+  pthread_key_create(&worker_key, worker_free);
+}
+
+static void worker_free(void *arg) {
+  CompileWorker *worker = arg;
+  for (size_t i = 0; i < worker->machine_count; ++i) {
+    LLVMDisposeTargetMachine(worker->machines[i].machine);
+    free(worker->machines[i].cpu);
+    free(worker->machines[i].features);
+  }
+  SmlCompiler_Free(&worker->compiler);
+  free(worker);
+}
+
+// Target machines are costly to create and immutable, keep the most recent
+static LLVMTargetMachineRef worker_machine(CompileWorker *worker,
+                                           int opt_level, const char *cpu,
+                                           const char *features,
+                                           Diagnostics *diag) {
+  cpu = cpu ? cpu : "";
+  features = features ? features : "";
+  for (size_t i = 0; i < worker->machine_count; ++i) {
+    WarmMachine *warm = &worker->machines[i];
+    if (warm->opt_level == opt_level && strcmp(warm->cpu, cpu) == 0 &&
+        strcmp(warm->features, features) == 0) {
+      return warm->machine;
+    }
+  }
+
+  LLVMTargetMachineRef machine =
+      Backend_NewTargetMachine(opt_level, *cpu ? cpu : NULL,
+                               *features ? features : NULL, diag);
+  if (!machine) {
+    return NULL;
+  }
+  if (worker->machine_count == SML_WORKER_MACHINES) {
+    WarmMachine *oldest = &worker->machines[0];
+    LLVMDisposeTargetMachine(oldest->machine);
+    free(oldest->cpu);
+    free(oldest->features);
+    memmove(worker->machines, worker->machines + 1,
+            sizeof(WarmMachine) * (SML_WORKER_MACHINES - 1));
+    worker->machine_count--;
+  }
+  worker->machines[worker->machine_count++] = (WarmMachine){
+      .opt_level = opt_level,
+      .cpu = strdup(cpu),
+      .features = strdup(features),
+      .machine = machine,
+  };
+  return machine;
+}
@@ -0,0 +1,50 @@
+#ifndef SML_WORKER
+#define SML_WORKER
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <llvm-c/TargetMachine.h>
+
+#include "compiler.h"
+#include "options.h"
+
+// Compilations after which a worker's LLVM context is recreated, so the
+// constants it accumulates don't grow without bound
+#define SML_WORKER_CONTEXT_USES 1000
+// Target machines a worker keeps warm, one per distinct -O/-mcpu/-mattr
+#define SML_WORKER_MACHINES 8
+
+typedef struct WarmMachine {
+  int opt_level;
+  char *cpu;
+  char *features;
+  LLVMTargetMachineRef machine;
+} WarmMachine;
+
+/*
+ * Compiler state a thread keeps from one file to the next, for the compile
+ * server and batch builds: an LLVM context with the standard library and
+ * the target machines of recent flags.
+ */
+typedef struct CompileWorker {
+  SmlCompiler compiler;
+  size_t uses;
+  WarmMachine machines[SML_WORKER_MACHINES];
+  size_t machine_count;
+} CompileWorker;
+
+// The calling thread's worker, set up on first use and freed when the
+// thread exits, which for pool threads is when the pool is freed. The main
+// thread's is left to the end of the process.
+CompileWorker *CompileWorker_ForThread(void);
+
+// `sml [args] source` without printing anything: reads source_path, names
+// the module source_name and writes output_path. Non-zero on failure, the
+// reasons are in worker->compiler.diag, which is cleared first; they name
+// the source when args has more than one.
+int CompileWorker_CompileFile(CompileWorker *worker, const SmlArgs *args,
+                              const char *source_path, char *source_name,
+                              char *output_path);
+
+#endif